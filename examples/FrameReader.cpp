@@ -0,0 +1,81 @@
+/// <summary>
+/// Sample consumer for frames the emulator shares (Options > Share Frames)
+/// ===================================================================================
+/// Follows every published frame, counts the ones it got and the ones the
+/// ring overwrote before it looked, and once a second prints those counts
+/// with the newest screen drawn in text. Needs nothing from the emulator
+/// but SharedFrames.h and SharedFrames.cpp.
+///
+///   frame-reader [region name]
+///
+/// Build with the chip-8-frame-reader project, or on Linux:
+///   g++ -O2 -Isrc examples/FrameReader.cpp src/SharedFrames.cpp -o frame-reader
+/// ===================================================================================
+/// </summary>
+#include "SharedFrames.h"
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+namespace {
+	void printScreen(const SharedFrame& frame) {
+		char line[65];
+		line[64] = 0;
+		for (int y = 0; y < 32; y++) {
+			for (int x = 0; x < 64; x++) {
+				line[x] = (frame.screen[y * 8 + x / 8] >> (7 - x % 8)) & 1 ? '#' : '.';
+			}
+			printf("%s\n", line);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const char* name = argc > 1 ? argv[1] : SHARED_FRAME_NAME;
+	SharedFrameReader reader;
+
+	for (;;) {
+		if (!reader.open(name)) {
+			printf("Waiting for %s\n", name);
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			continue;
+		}
+
+		//start with whatever is published next
+		uint64_t next = reader.latest() + 1;
+		unsigned long long received = 0;
+		unsigned long long missed = 0;
+		std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+		SharedFrame frame;
+
+		while (!reader.isClosed()) {
+			uint64_t latest = reader.latest();
+			//anything older than the ring holds is gone
+			if (latest >= next + SHARED_FRAME_SLOTS) {
+				missed += latest - SHARED_FRAME_SLOTS + 1 - next;
+				next = latest - SHARED_FRAME_SLOTS + 1;
+			}
+			for (; next <= latest; next++) {
+				if (reader.read(next, frame)) received++;
+				else missed++;
+			}
+
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now - lastReport >= std::chrono::seconds(1)) {
+				lastReport = now;
+				if (reader.readLatest(frame)) {
+					printScreen(frame);
+					printf("seq %llu  frame %llu  pc %03X  I %03X  received %llu  missed %llu\n",
+						(unsigned long long)frame.seq, (unsigned long long)frame.frame, frame.pc, frame.i, received, missed);
+				}
+			}
+
+			//a 60hz writer fills the ring in about a second, so this never falls behind
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+
+		printf("%s closed\n", name);
+		reader.close();
+	}
+}
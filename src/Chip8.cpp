@@ -1,9 +1,17 @@
 #include "Chip8.h"
-#include <stdlib.h>
-#include <iostream>
+#include "Debugger.h"
 
 #define FONTSET_OFFSET 0x050
 #define PROGRAM_OFFSET 0x200
+#define DEFAULT_SEED 0x2545f491
+
+//COSMAC VIP: 1.76064MHz clock, 8 clocks per machine cycle, 60hz display
+#define VIP_CYCLES_PER_FRAME 3668
+//Taken by the display every frame. 8 bytes of DMA for each of
+//128 scanlines and the interrupt routine
+#define VIP_VIDEO_CYCLES 1068
+//Left for the interpreter
+#define VIP_FRAME_BUDGET (VIP_CYCLES_PER_FRAME - VIP_VIDEO_CYCLES)
 
 /// <summary>
 /// 0x0NNN Machine code subroutine
@@ -18,7 +26,7 @@ void Chip8::call() {
 /// Clears the display
 /// </summary>
 void Chip8::disp_clear() {
-	for (int i = 0; i < 64 * 32; i++) {
+	for (int i = 0; i < 32 * 8; i++) {
 		graphic[i] = 0;
 	}
 	drawFlag = 1;
@@ -30,7 +38,8 @@ void Chip8::disp_clear() {
 /// Address from the stack
 /// </summary>
 void Chip8::ret() {
-	sp--;
+	//the stack is a ring of 16, so a ROM returning more than it called can't read past it
+	sp = (sp - 1) & 0x0f;
 	pc = stack[sp];
 }
 
@@ -50,7 +59,7 @@ void Chip8::go_to() {
 /// </summary>
 void Chip8::subroutine() {
 	stack[sp] = pc; //set current stack to program counter
-	sp++; //increment stack pointer by 1
+	sp = (sp + 1) & 0x0f; //increment stack pointer by 1. the 17th call overwrites the first
 	pc = opcode & 0x0FFF; //set pc to NNN
 }
 
@@ -254,29 +263,53 @@ void Chip8::jmpToNNNAddV0() {
 void Chip8::randAndNN() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
 	unsigned char nn = (opcode & 0x00ff);
-	V[x] = (rand() % 0x100) & nn;
+	V[x] = (nextRandom() % 0x100) & nn;
 }
 
 /// <summary>
 /// DXYN
 /// Draw a sprite of height N at position (V[x], V[y]),
-/// with the sprite location in memory pointed to by I
+/// with the sprite location in memory pointed to by I.
+/// Pixels going off the screen wrap around to the other side
 /// </summary>
 void Chip8::draw() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
 	unsigned char y = (opcode & 0x00f0) >> 4;
 	unsigned char n = (opcode & 0x000f);
-	V[0xf] = 0;
+	//read the position before VF gets reset, in case x or y is F
+	bool collision = drawSprite(graphic, memory, I, V[x], V[y], n);
+	V[0xf] = collision ? 1 : 0;
+	drawFlag = 1;
+}
+
+/// <summary>
+/// XOR a sprite onto a packed screen
+/// </summary>
+/// <returns>true if any pixel got turned off</returns>
+bool Chip8::drawSprite(unsigned char* graphic, const unsigned char* memory, unsigned short I, unsigned char vx, unsigned char vy, unsigned char n) {
+	bool collision = false;
+	unsigned int shift = vx % 64;
 	for (int row = 0; row < n; row++) {
-		for (int col = 0; col < 8; col++) {
-			unsigned char bit = (memory[I + (row)] >> (7 - col)) & 0x01;
-			unsigned int pos = 64 * (V[y] + row) + (V[x] + col);
-			if((graphic[pos] & bit) == 1)
-				V[0xf] = 1;
-			graphic[pos] = (graphic[pos]^bit);
+		unsigned char* line = graphic + 8 * ((vy + row) % 32);
+
+		//the sprite byte as a full 64 pixel row, rotated to its x position.
+		//rotating is what wraps pixels past the right edge to the left
+		unsigned long long sprite = (unsigned long long)memory[(I + row) & 0x0fff] << 56;
+		if (shift != 0) sprite = (sprite >> shift) | (sprite << (64 - shift));
+
+		unsigned long long pixels = 0;
+		for (int i = 0; i < 8; i++) {
+			pixels = (pixels << 8) | line[i];
+		}
+		if ((pixels & sprite) != 0)
+			collision = true;
+		pixels ^= sprite;
+		for (int i = 7; i >= 0; i--) {
+			line[i] = pixels & 0xff;
+			pixels >>= 8;
 		}
 	}
-	drawFlag = 1;
+	return collision;
 }
 
 /// <summary>
@@ -286,7 +319,7 @@ void Chip8::draw() {
 /// </summary>
 void Chip8::ifKeyEqVx() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
-	if (key[V[x]] != 0) {
+	if (key[V[x] & 0x0f] != 0) {
 		pc += 2;
 		return;
 	}
@@ -299,7 +332,7 @@ void Chip8::ifKeyEqVx() {
 /// </summary>
 void Chip8::ifKeyNotEqVx() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
-	if (key[V[x]] == 0) {
+	if (key[V[x] & 0x0f] == 0) {
 		pc += 2;
 		return;
 	}
@@ -325,9 +358,11 @@ void Chip8::waitKey() {
 	for (unsigned char i = 0; i < 16; i++) {
 		if (key[i] != 0) {
 			V[x] = i;
+			keyWait = 0;
 			return;
 		}
 	}
+	keyWait = 1;
 	//simulate blocking
 	//TODO: DO PROPER BLOCKING
 	pc -= 2;
@@ -353,7 +388,8 @@ void Chip8::setSoundTimer() {
 
 /// <summary>
 /// FX1E
-/// Adds V[x] to I
+/// Adds V[x] to I. I can go past 0xFFF, every
+/// access through it wraps around to the start of memory
 /// </summary>
 void Chip8::iAddVx() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
@@ -378,11 +414,13 @@ void Chip8::iToSprAdd() {
 void Chip8::setBCD() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
 	unsigned short vx = V[x];
-	memory[I] = vx / 100;
+	unsigned short at = I & 0x0fff;
+	memory[at] = vx / 100;
 	vx -= (vx/100) * 100;
-	memory[I + 1] = vx / 10;
+	memory[(at + 1) & 0x0fff] = vx / 10;
 	vx -= (vx / 10) * 10;
-	memory[I + 2] = vx;
+	memory[(at + 2) & 0x0fff] = vx;
+	markCodeWritten(at, at + 2);
 }
 
 /// <summary>
@@ -392,9 +430,11 @@ void Chip8::setBCD() {
 /// </summary>
 void Chip8::regDump() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
+	unsigned short at = I & 0x0fff;
 	for (int i = 0; i <= x; i++) {
-		memory[I + i] = V[i];
+		memory[(at + i) & 0x0fff] = V[i];
 	}
+	markCodeWritten(at, at + x);
 }
 
 /// <summary>
@@ -405,7 +445,7 @@ void Chip8::regDump() {
 void Chip8::regLoad() {
 	unsigned char x = (opcode & 0x0f00) >> 8;
 	for (int i = 0; i <= x; i++) {
-		V[i] = memory[I + i];
+		V[i] = memory[(I + i) & 0x0fff];
 	}
 }
 
@@ -422,6 +462,10 @@ void Chip8::initialize() {
 	delay_timer = 0;
 	sound_timer = 0;
 	sleepTimer = 0;
+	timing = Timing::Flat;
+	frame = 0;
+	cycles = 0;
+	seedRandom(DEFAULT_SEED);
 
 	//Clear general register, stack, and key
 	for (int i = 0; i < 16; i++) {
@@ -431,9 +475,10 @@ void Chip8::initialize() {
 	}
 
 	drawFlag = 0;
+	keyWait = 0;
 	
 	//Clear screen
-	for (int i = 0; i < 64 * 32; i++) {
+	for (int i = 0; i < 32 * 8; i++) {
 		graphic[i] = 0;
 	}
 
@@ -471,6 +516,29 @@ void Chip8::initialize() {
 			memory[FONTSET_OFFSET + (i * 5) + x] = chip8_fontset[(i * 5) + x];
 		}
 	}
+	fusionFrom = 0;
+	fusionTo = 4095;
+	writtenFrom = 0;
+	writtenTo = 4095;
+}
+
+/// <summary>
+/// Seed the random number generator used by CXNN.
+/// Two machines with the same seed and input produce the same results
+/// </summary>
+void Chip8::seedRandom(unsigned int seed) {
+	//xorshift gets stuck on 0
+	rng = seed != 0 ? seed : DEFAULT_SEED;
+}
+
+/// <summary>
+/// xorshift32
+/// </summary>
+unsigned int Chip8::nextRandom() {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
 }
 
 /// <summary>
@@ -478,19 +546,87 @@ void Chip8::initialize() {
 /// </summary>
 /// <returns>our opcode</returns>
 unsigned short Chip8::fetch() {
-	unsigned short op = memory[pc] << 8 | memory[pc + 1];
+	//BNNN and running off the end can take pc past 0xFFF
+	unsigned short op = memory[pc & 0x0fff] << 8 | memory[(pc + 1) & 0x0fff];
 	pc += 2;
 	return op;
 }
 
+namespace {
+	//Approximate COSMAC VIP machine cycles per instruction. Every
+	//instruction goes through the same fetch and dispatch first
+	constexpr unsigned short VIP_FETCH_CYCLES = 40;
+	//Execution by the top nibble, the same decode cycle() switches on.
+	//0x0 is 00EE and 0NNN, 0xD is per sprite and 0xF is per instruction
+	constexpr unsigned short VIP_EXECUTE_CYCLES[16] = {
+		10, //0NNN 00EE
+		12, //1NNN
+		26, //2NNN
+		10, //3XNN
+		10, //4XNN
+		14, //5XY0
+		6, //6XNN
+		10, //7XNN
+		44, //8XYN, one shared routine
+		14, //9XY0
+		12, //ANNN
+		22, //BNNN
+		36, //CXNN
+		26, //DXYN, plus each row
+		14, //EX9E EXA1
+		0 //FXNN
+	};
 
-void Chip8::doCycle() {
-	//every opcode is 2 bytes long. stored in big endian
-	opcode = fetch();
+	/// <summary>
+	/// Machine cycles an instruction takes on the VIP
+	/// </summary>
+	/// <param name="vx">V[X] of the instruction, sprites cost more off a byte boundary</param>
+	constexpr unsigned int vipCycles(unsigned short op, unsigned char vx) {
+		unsigned int x = (op & 0x0f00) >> 8;
+		switch ((op & 0xf000) >> 12) {
+		case 0x0:
+			//clears the 256 byte display one byte at a time
+			if (op == 0x00e0) return VIP_FETCH_CYCLES + 2048;
+			break;
+		case 0xd:
+			//the row is shifted into place bit by bit unless x is aligned
+			return VIP_FETCH_CYCLES + VIP_EXECUTE_CYCLES[0xd] + (op & 0x000f) * ((vx & 7) ? 42 : 18);
+		case 0xf:
+			switch (op & 0x00ff) {
+			case 0x1e:
+			case 0x29:
+				return VIP_FETCH_CYCLES + 16;
+			case 0x33:
+				//repeated subtraction for each digit
+				return VIP_FETCH_CYCLES + 180;
+			case 0x55:
+			case 0x65:
+				return VIP_FETCH_CYCLES + 14 + 14 * (x + 1);
+			default:
+				//FX07 FX0A FX15 FX18
+				return VIP_FETCH_CYCLES + 10;
+			}
+		}
+		return VIP_FETCH_CYCLES + VIP_EXECUTE_CYCLES[(op & 0xf000) >> 12];
+	}
+	static_assert(vipCycles(0x6000, 0) == 46, "VIP cycle table");
+}
+
+/// <summary>
+/// Bookkeeping done for every instruction after it is fetched
+/// </summary>
+void Chip8::startInstruction() {
+	cycles++;
 
 	//reset draw flag
 	drawFlag = 0;
 
+	if (timing == Timing::Vip) {
+		//the frame ends after the instruction, see endVipInstruction
+		sleepTimer += vipCycles(opcode, V[(opcode & 0x0f00) >> 8]);
+		return;
+	}
+
 	//this is a very basic timer implementation.
 	//since CHIP8 has a refresh rate of 500hz, Roughly
 	//1/60th of a second passes every 8 clock pulse.
@@ -499,12 +635,100 @@ void Chip8::doCycle() {
 	sleepTimer++;
 	sleepTimer %= 8;
 
-	if (sound_timer > 0) std::cout << "BEEP" << std::endl;
+	if (sleepTimer == 0) tickTimers();
+}
+
+/// <summary>
+/// 60hz tick
+/// </summary>
+void Chip8::tickTimers() {
+	frame++;
+	if (delay_timer > 0) delay_timer--;
+	if (sound_timer > 0) sound_timer--;
+}
+
+/// <summary>
+/// Vip timing bookkeeping, done after the instruction ran
+/// </summary>
+void Chip8::endVipInstruction() {
+	//the VIP only draws sprites right after the display interrupt.
+	//the wait is the rest of this frame, so DXYN runs first in the next
+	if ((memory[pc & 0xfff] & 0xf0) == 0xd0 && sleepTimer < VIP_FRAME_BUDGET) sleepTimer = VIP_FRAME_BUDGET;
+
+	if (sleepTimer >= VIP_FRAME_BUDGET) {
+		sleepTimer -= VIP_FRAME_BUDGET;
+		tickTimers();
+	}
+}
+
+void Chip8::setTiming(Timing t) {
+	if (t == timing) return;
+	//same point in the frame
+	unsigned int perFrame = getTimePerFrame();
+	timing = t;
+	sleepTimer = (unsigned short)(sleepTimer * getTimePerFrame() / perFrame);
+}
+
+unsigned int Chip8::getTimePerFrame() const {
+	return timing == Timing::Vip ? VIP_FRAME_BUDGET : 8;
+}
+
+namespace {
+	/// <summary>
+	/// Hooks for the release interpreter. Everything here is
+	/// inlined away
+	/// </summary>
+	struct NoDebugHooks {
+		inline bool beforeExecute(const Chip8&) { return true; }
+	};
+
+	/// <summary>
+	/// runFrame's hooks. The only ones that let cycle() run fused
+	/// sequences, up to the end of the frame
+	/// </summary>
+	struct FrameHooks : NoDebugHooks {
+		FusionTable* fusion;
+		unsigned long long endFrame;
+	};
+
+	/// <summary>
+	/// runFrame's hooks when recording coverage
+	/// </summary>
+	struct CoverageHooks {
+		unsigned char* visited;
+		int newlyVisited;
+		inline bool beforeExecute(const Chip8& core) {
+			unsigned short pc = core.getPc() & 0x0fff;
+			newlyVisited += visited[pc] ^ 1;
+			visited[pc] = 1;
+			return true;
+		}
+	};
+
+	//frame fused sequences may run until. 0 turns fusion off
+	template<class Hooks>
+	inline unsigned long long fuseUntil(const Hooks&) { return 0; }
+	inline unsigned long long fuseUntil(const FrameHooks& hooks) { return hooks.endFrame; }
+	//the table fused sequences are looked up in. Only read when fuseUntil isn't 0
+	template<class Hooks>
+	inline FusionTable* fusionOf(const Hooks&) { return nullptr; }
+	inline FusionTable* fusionOf(const FrameHooks& hooks) { return hooks.fusion; }
 
-	if (sleepTimer == 0) {
-		if (delay_timer > 0) delay_timer--;
-		if (sound_timer > 0) sound_timer--;
+	/// <summary>
+	/// The instruction at an address, 0 past the end of memory
+	/// </summary>
+	inline unsigned short opcodeAt(const unsigned char* memory, int at) {
+		return at + 1 < 4096 ? memory[at] << 8 | memory[at + 1] : 0;
 	}
+}
+
+template<class Hooks>
+bool Chip8::cycle(Hooks& hooks) {
+	if (!hooks.beforeExecute(*this)) return false;
+
+	//every opcode is 2 bytes long. stored in big endian
+	opcode = fetch();
+	startInstruction();
 
 	//channel the opcode to correct operation
 	switch ((opcode & 0xf000) >> 12) {
@@ -538,9 +762,11 @@ void Chip8::doCycle() {
 		break;
 	case 0x6:
 		vxToNN();
+		if (frame < fuseUntil(hooks)) runFused(*fusionOf(hooks), fuseUntil(hooks));
 		break;
 	case 0x7:
 		vxAddNN();
+		if (frame < fuseUntil(hooks)) runFused(*fusionOf(hooks), fuseUntil(hooks));
 		break;
 	case 0x8:
 		switch (opcode & 0x000f) {
@@ -578,6 +804,7 @@ void Chip8::doCycle() {
 		break;
 	case 0xa:
 		iToNNN();
+		if (frame < fuseUntil(hooks)) runFused(*fusionOf(hooks), fuseUntil(hooks));
 		break;
 	case 0xb:
 		jmpToNNNAddV0();
@@ -602,6 +829,7 @@ void Chip8::doCycle() {
 		switch (opcode & 0x00ff) {
 		case 0x07:
 			getDelay();
+			if (frame < fuseUntil(hooks)) runFused(*fusionOf(hooks), fuseUntil(hooks));
 			break;
 		case 0x0a:
 			waitKey();
@@ -617,6 +845,7 @@ void Chip8::doCycle() {
 			break;
 		case 0x29:
 			iToSprAdd();
+			if (frame < fuseUntil(hooks)) runFused(*fusionOf(hooks), fuseUntil(hooks));
 			break;
 		case 0x33:
 			setBCD();
@@ -630,28 +859,234 @@ void Chip8::doCycle() {
 		}
 		break;
 	}
+
+	if (timing == Timing::Vip) endVipInstruction();
+	return true;
+}
+
+void Chip8::doCycle() {
+	NoDebugHooks hooks;
+	cycle(hooks);
+}
+
+bool Chip8::doCycle(Debugger& debugger) {
+	return cycle(debugger);
+}
+
+bool Chip8::runFrame() {
+	bool drew = false;
+	unsigned long long target = frame + 1;
+	NoDebugHooks hooks;
+	while (frame < target) {
+		cycle(hooks);
+		if (drawFlag) drew = true;
+	}
+	return drew;
+}
+
+bool Chip8::runFrame(FusionTable& fusion) {
+	bool drew = false;
+	unsigned long long target = frame + 1;
+	FrameHooks hooks;
+	hooks.fusion = &fusion;
+	hooks.endFrame = target;
+	while (frame < target) {
+		cycle(hooks);
+		//a fused sequence ends on its only drawing instruction
+		if (drawFlag) drew = true;
+	}
+	return drew;
+}
+
+bool Chip8::runFrame(unsigned char* visited, int& newlyVisited) {
+	bool drew = false;
+	unsigned long long target = frame + 1;
+	CoverageHooks hooks;
+	hooks.visited = visited;
+	hooks.newlyVisited = 0;
+	while (frame < target) {
+		cycle(hooks);
+		if (drawFlag) drew = true;
+	}
+	newlyVisited = hooks.newlyVisited;
+	return drew;
+}
+
+/// <summary>
+/// Memory between two addresses changed. The fused sequences that
+/// overlap it get found again before runFrame next looks at them.
+/// Only the range is kept here, so the instructions that write memory
+/// stay small. to can be past 0xFFF for a write that wrapped around
+/// </summary>
+void Chip8::markCodeWritten(int from, int to) {
+	if (to > 4095) {
+		markCodeWritten(0, to & 0x0fff);
+		to = 4095;
+	}
+	if (from < writtenFrom) writtenFrom = from;
+	if (to > writtenTo) writtenTo = to;
+
+	//a sequence starting up to 5 bytes earlier can reach into the range
+	from -= 5;
+	if (from < fusionFrom) fusionFrom = from;
+	if (to > fusionTo) fusionTo = to;
+}
+
+FusionTable::FusionTable() {
+	for (int i = 0; i < 2048; i++) {
+		kinds[i] = Kind::None;
+	}
+}
+
+/// <summary>
+/// The sequence starting with three instructions, if any
+/// </summary>
+FusionTable::Kind FusionTable::match(unsigned short op0, unsigned short op1, unsigned short op2) {
+	unsigned short x = op0 & 0x0f00;
+	if ((op0 & 0xf000) == 0xa000 && (op1 & 0xf000) == 0xd000)
+		return Kind::Sprite;
+	if ((op0 & 0xf000) == 0x6000 && ((op1 & 0xf0ff) == 0xf015 || (op1 & 0xf0ff) == 0xf018) && (op1 & 0x0f00) == x)
+		return Kind::Timer;
+	if ((op0 & 0xf0ff) == 0xf007 && (op1 & 0xf0ff) == 0x3000 && (op1 & 0x0f00) == x && (op2 & 0xf000) == 0x1000)
+		return Kind::DelayWait;
+	if ((op0 & 0xf000) == 0x7000 && (op1 & 0xf000) == 0x3000 && (op1 & 0x0f00) == x && (op2 & 0xf000) == 0x1000)
+		return Kind::Loop;
+	if ((op0 & 0xf0ff) == 0xf029 && (op1 & 0xf000) == 0xd000)
+		return Kind::Digit;
+	return Kind::None;
+}
+
+/// <summary>
+/// Rescan whatever core wrote since a table last looked at it
+/// </summary>
+void FusionTable::refresh(Chip8& core) {
+	if (core.fusionFrom > core.fusionTo) return;
+	scan(core, core.fusionFrom, core.fusionTo);
+	core.fusionFrom = 4096;
+	core.fusionTo = -1;
+}
+
+/// <summary>
+/// Find the fused sequences starting between two addresses
+/// </summary>
+void FusionTable::scan(const Chip8& core, int from, int to) {
+	if (from < 0) from = 0;
+	if (to > 4095) to = 4095;
+	for (int at = from & ~1; at <= to; at += 2) {
+		kinds[at >> 1] = match(opcodeAt(core.memory, at), opcodeAt(core.memory, at + 2), opcodeAt(core.memory, at + 4));
+	}
+}
+
+/// <summary>
+/// Bookkeeping for a fused sequence of count instructions, the last of
+/// which is op. runFused makes sure only the last one can tick the timers
+/// </summary>
+void Chip8::finishFused(unsigned short op, int count) {
+	opcode = op;
+	pc += 2 * count;
+	cycles += count;
+	drawFlag = 0;
+	sleepTimer += count;
+	if (sleepTimer == 8) {
+		sleepTimer = 0;
+		tickTimers();
+	}
+}
+
+/// <summary>
+/// Called by cycle() right after an instruction that can start a fused
+/// sequence. If it does, runs the rest of the sequence as one step, with
+/// the same result as running the instructions one by one. DelayWait and
+/// Loop keep going while they jump back to their own start, until the
+/// frame ends. Stops early, leaving the rest to cycle(), wherever the
+/// timers would tick before the last instruction of a step
+/// </summary>
+void Chip8::runFused(FusionTable& fusion, unsigned long long endFrame) {
+	//the batched bookkeeping below is Flat timing's
+	if (timing != Timing::Flat) return;
+
+	//code written during this frame. only this path reads the table,
+	//so only this path needs it rescanned
+	fusion.refresh(*this);
+	unsigned short start = pc - 2;
+	if (start & 0xf001) return;
+	FusionTable::Kind kind = fusion.kinds[start >> 1];
+	if (kind == FusionTable::Kind::None) return;
+
+	//the table may have been scanned from another copy of this machine
+	unsigned short op0 = opcode;
+	unsigned short op1 = opcodeAt(memory, pc);
+	unsigned short op2 = opcodeAt(memory, start + 4);
+	if (FusionTable::match(op0, op1, op2) != kind) return;
+	//none of these write memory, so the sequence can't change under us
+	unsigned char x = (op0 & 0x0f00) >> 8;
+
+	//sleepTimer is below 8 here, so a single instruction always fits
+	switch (kind) {
+	case FusionTable::Kind::Sprite:
+	case FusionTable::Kind::Digit:
+		finishFused(op1, 1);
+		draw();
+		break;
+	case FusionTable::Kind::Timer:
+		//the timers tick before the second instruction sets them
+		finishFused(op1, 1);
+		if ((op1 & 0x00ff) == 0x15)
+			setDelay();
+		else
+			setSoundTimer();
+		break;
+	case FusionTable::Kind::DelayWait:
+	case FusionTable::Kind::Loop: {
+		unsigned char nn = op1 & 0x00ff;
+		for (;;) {
+			if (V[x] == nn) {
+				//skipped over the jump
+				finishFused(op1, 1);
+				pc += 2;
+				return;
+			}
+			if (sleepTimer + 2 > 8) return;
+			finishFused(op2, 2);
+			pc = op2 & 0x0fff;
+			if (pc != start || frame >= endFrame || sleepTimer + 3 > 8) return;
+
+			//the first instruction again
+			if (kind == FusionTable::Kind::DelayWait)
+				V[x] = delay_timer;
+			else
+				V[x] += op0 & 0x00ff;
+			finishFused(op0, 1);
+		}
+	}
+	default:
+		break;
+	}
 }
 
 /// <summary>
 /// Load rom to our Chip-8 Machine
 /// </summary>
 /// <param name="data">data to load</param>
-/// <param name="len">size of data in bytes</param>
-void Chip8::loadProgram(char* data, int len) {
+/// <param name="len">size of data in bytes. Anything past the end of memory is dropped</param>
+void Chip8::loadProgram(const char* data, int len) {
+	if (len > 4096 - PROGRAM_OFFSET) len = 4096 - PROGRAM_OFFSET;
 	for (int i = 0; i < len; i++) {
 		memory[PROGRAM_OFFSET + i] = data[i];
 	}
+	markCodeWritten(PROGRAM_OFFSET, PROGRAM_OFFSET + len - 1);
 }
 
 /// <summary>
 /// Fill a char buffer with our screen information
 /// </summary>
 /// <param name="screenBuf">buffer to fill</param>
-void Chip8::loadScreen(unsigned char* screenBuf) {
+void Chip8::loadScreen(unsigned char* screenBuf) const {
 	for (int i = 0; i < 64 * 32; i++) {
-		screenBuf[i*3] = graphic[i] * 255;
-		screenBuf[i*3+1] = graphic[i] * 255;
-		screenBuf[i*3+2] = graphic[i] * 255;
+		unsigned char pixel = ((graphic[i / 8] >> (7 - i % 8)) & 0x01) * 255;
+		screenBuf[i*3] = pixel;
+		screenBuf[i*3+1] = pixel;
+		screenBuf[i*3+2] = pixel;
 	}
 }
 
@@ -659,4 +1094,45 @@ void Chip8::loadKey(unsigned char* keys) {
 	for (int i = 0; i < 16; i++) {
 		this->key[i] = keys[i];
 	}
+}
+
+/// <summary>
+/// Update a single key
+/// </summary>
+/// <param name="index">key to update. 0x0 - 0xF</param>
+/// <param name="pressed">new state of the key</param>
+void Chip8::setKey(unsigned char index, bool pressed) {
+	key[index & 0x0f] = pressed ? 1 : 0;
+}
+
+namespace {
+	/// <summary>
+	/// FNV-1a over a block of memory
+	/// </summary>
+	unsigned long long fnv1a(unsigned long long h, const void* data, int len) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (int i = 0; i < len; i++) {
+			h ^= bytes[i];
+			h *= 0x100000001b3ULL;
+		}
+		return h;
+	}
+}
+
+unsigned long long Chip8::hash() const {
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	h = fnv1a(h, memory, sizeof(memory));
+	h = fnv1a(h, V, sizeof(V));
+	h = fnv1a(h, &I, sizeof(I));
+	h = fnv1a(h, &pc, sizeof(pc));
+	h = fnv1a(h, graphic, sizeof(graphic));
+	h = fnv1a(h, &delay_timer, sizeof(delay_timer));
+	h = fnv1a(h, &sound_timer, sizeof(sound_timer));
+	h = fnv1a(h, stack, sizeof(stack));
+	h = fnv1a(h, &sp, sizeof(sp));
+	h = fnv1a(h, key, sizeof(key));
+	h = fnv1a(h, &sleepTimer, sizeof(sleepTimer));
+	h = fnv1a(h, &timing, sizeof(timing));
+	h = fnv1a(h, &rng, sizeof(rng));
+	return h;
 }
\ No newline at end of file
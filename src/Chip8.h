@@ -1,4 +1,10 @@
 #pragma once
+class Debugger;
+class StateView;
+class Chip8Batch;
+class CompactRunner;
+class FusionTable;
+
 /// <summary>
 /// Chip 8 Implementation
 /// ===================================================================================
@@ -7,9 +13,25 @@
 /// https://en.wikipedia.org/wiki/CHIP-8#Opcode_table
 /// ===================================================================================
 /// For info on the private functions, see Chip8.cpp
+///
+/// Chip8 is plain data with no side effects outside itself, so copying
+/// it is a full save state. Restoring is copying it back.
 /// </summary>
 class Chip8
 {
+	friend class Debugger;
+	friend class StateView;
+	friend class Chip8Batch;
+	friend class CompactRunner;
+	friend class FusionTable;
+public:
+	/// <summary>
+	/// How long instructions take
+	/// </summary>
+	enum class Timing {
+		Flat, //Every instruction the same, 8 per 60hz frame
+		Vip //Machine cycles of the COSMAC VIP interpreter. DXYN waits for the next frame
+	};
 private:
 	unsigned short opcode;
 	/*
@@ -21,7 +43,7 @@ private:
 	unsigned char V[16]; //General purpose registers
 	unsigned short I; //Index register
 	unsigned short pc; //Program counter
-	unsigned char graphic[64 * 32]; //Monochrome screen. Only need 8*4 bytes. is 64*32 for simplicity
+	unsigned char graphic[32 * 8]; //Monochrome screen. 1 bit per pixel, 8 bytes per row, most significant bit is the leftmost pixel
 
 	/// <summary>
 	/// Both of these count down to 0. These are refreshed at a frequency of 60hz
@@ -34,15 +56,45 @@ private:
 	unsigned short sp; //Stack pointer
 
 	unsigned char key[16]; //Track current position of key
-	unsigned short sleepTimer;
+	unsigned short sleepTimer; //Flat: instructions into the current frame. Vip: machine cycles into it
+	Timing timing;
+	unsigned long long frame; //Number of 60hz timer ticks since initialize
+	unsigned long long cycles; //Number of instructions run since initialize
+	unsigned char keyWait; //Set while FX0A is blocking
+	unsigned int rng; //xorshift state for CXNN. Kept per machine so copies replay identically
+
+	unsigned int nextRandom();
 
 	unsigned short fetch();
+	void startInstruction();
+	void tickTimers();
+	void endVipInstruction();
+
+	//Where fused sequences may have changed since a FusionTable last
+	//rescanned this machine. The table itself lives outside, so copies
+	//stay plain machine state
+	int fusionFrom;
+	int fusionTo;
+	//Memory written since CompactRunner last reset the range. Nothing else reads it
+	int writtenFrom;
+	int writtenTo;
+	void markCodeWritten(int from, int to);
+	void runFused(FusionTable& fusion, unsigned long long endFrame);
+	void finishFused(unsigned short op, int count);
+
+	/// <summary>
+	/// The interpreter loop. Hooks is only ever a Debugger or an empty
+	/// no-op type, so the release instantiation has no debug checks at all
+	/// </summary>
+	template<class Hooks>
+	bool cycle(Hooks& hooks);
 
 	//call
 	void call();
 	//display
 	void disp_clear();
 	void draw();
+	static bool drawSprite(unsigned char* graphic, const unsigned char* memory, unsigned short I, unsigned char vx, unsigned char vy, unsigned char n);
 	//flow
 	void ret();
 	void go_to();
@@ -93,10 +145,35 @@ private:
 	void setBCD();
 public:
 	void initialize();
-	void loadProgram(char* data, int len);
-	void loadScreen(unsigned char* screenBuf);
+	void loadProgram(const char* data, int len);
+	void loadScreen(unsigned char* screenBuf) const;
 	void loadKey(unsigned char* keys);
+	void setKey(unsigned char index, bool pressed);
+	void seedRandom(unsigned int seed);
 	void doCycle();
+	/// <summary>
+	/// Same as doCycle() but checks breakpoints, watchpoints
+	/// and stepping before running the instruction
+	/// </summary>
+	/// <returns>false if the debugger stopped the machine</returns>
+	bool doCycle(Debugger& debugger);
+	/// <summary>
+	/// Run until the next 60hz timer tick
+	/// </summary>
+	/// <returns>true if anything was drawn during the frame</returns>
+	bool runFrame();
+	/// <summary>
+	/// Same as runFrame() but runs common opcode sequences found in
+	/// fusion as one step each. The result is the same either way
+	/// </summary>
+	bool runFrame(FusionTable& fusion);
+	/// <summary>
+	/// Same as runFrame() but records which addresses ran. visited is 4096
+	/// bytes, visited[pc] is set to 1 for every instruction. Fused sequences
+	/// would skip the recording, so they are off
+	/// </summary>
+	/// <param name="newlyVisited">receives how many entries went from 0 to 1</param>
+	bool runFrame(unsigned char* visited, int& newlyVisited);
 
 	/// <summary>
 	/// Basic debugging info for our CHIP-8 machine
@@ -105,11 +182,13 @@ public:
 		unsigned short pc = 0;
 		unsigned short opcode = 0;
 		unsigned char V[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-		unsigned char i = 0;
+		unsigned short i = 0;
 		unsigned short timer_delay = 0;
 		unsigned short timer_sound = 0;
+		unsigned short stack[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+		unsigned short sp = 0;
 
-		DebugInfo(unsigned short pc, unsigned short opcode, unsigned char* V, unsigned char i, unsigned timer_delay, unsigned timer_sound) {
+		DebugInfo(unsigned short pc, unsigned short opcode, const unsigned char* V, unsigned short i, unsigned timer_delay, unsigned timer_sound, const unsigned short* stack, unsigned short sp) {
 			this->pc = pc;
 			this->opcode = opcode;
 			for (int i = 0; i < 16; i++) {
@@ -119,12 +198,91 @@ public:
 
 			this->timer_delay = timer_delay;
 			this->timer_sound = timer_sound;
+
+			for (int i = 0; i < 16; i++) {
+				this->stack[i] = stack[i];
+			}
+			this->sp = sp;
 		}
 	};
 
-	DebugInfo dumpDebug() {
-		return DebugInfo(pc, opcode, V, I, delay_timer, sound_timer);
+	DebugInfo dumpDebug() const {
+		return DebugInfo(pc, opcode, V, I, delay_timer, sound_timer, stack, sp);
 	}
 
+	unsigned short getPc() const { return pc; }
+	unsigned long long getFrame() const { return frame; }
+	unsigned long long getCycles() const { return cycles; }
+
+	/// <summary>
+	/// Switch timing model. Keeps how far into the current frame we are.
+	/// initialize() goes back to Flat
+	/// </summary>
+	void setTiming(Timing t);
+	Timing getTiming() const { return timing; }
+	/// <summary>
+	/// Emulated time since initialize, in instructions for Flat timing
+	/// and VIP machine cycles for Vip. Counts the time DXYN waits
+	/// </summary>
+	unsigned long long getTime() const { return frame * getTimePerFrame() + sleepTimer; }
+	/// <summary>
+	/// getTime() units in one 60hz frame
+	/// </summary>
+	unsigned int getTimePerFrame() const;
+	bool isSoundOn() const { return sound_timer > 0; }
+	/// <summary>
+	/// True if the last instruction was an FX0A still waiting on a key
+	/// </summary>
+	bool isWaitingForKey() const { return keyWait != 0 && (opcode & 0xf0ff) == 0xf00a; }
+	/// <summary>
+	/// The screen as stored by the machine. 32 rows of 8 bytes,
+	/// most significant bit is the leftmost pixel
+	/// </summary>
+	const unsigned char* getScreen() const { return graphic; }
+
+	/// <summary>
+	/// Hash of everything that affects how the machine runs from here on.
+	/// Two machines with the same hash behave the same given the same input
+	/// </summary>
+	unsigned long long hash() const;
+
 	unsigned char drawFlag;
-};
\ No newline at end of file
+};
+
+/// <summary>
+/// Common opcode sequences runFrame(FusionTable&) runs without going back
+/// through the dispatch switch between them
+/// ===================================================================================
+/// Derived from a machine's memory, so it is kept apart from Chip8: one
+/// table serves a machine and all its copies and save states. Machines
+/// record where they write, and runFrame rescans just that part before it
+/// looks anything up. initialize() marks all of memory, so a table can
+/// move on to a new ROM without any setup. A copy restored from an older save state can still
+/// leave an entry out of date, so an entry is only a hint: the
+/// instructions are checked again before a sequence is fused, and a stale
+/// entry only costs the speedup there.
+/// ===================================================================================
+/// </summary>
+class FusionTable
+{
+	friend class Chip8;
+	friend class CompactRunner;
+public:
+	FusionTable();
+
+private:
+	enum class Kind : unsigned char {
+		None,
+		Sprite, //ANNN DXYN
+		Timer, //6XNN FX15 or 6XNN FX18, same X
+		DelayWait, //FX07 3X00 1NNN, same X
+		Loop, //7XNN 3XNN 1NNN, same X
+		Digit //FX29 DXYN
+	};
+	//Sequence starting at each even address, indexed by address / 2
+	Kind kinds[2048];
+
+	static Kind match(unsigned short op0, unsigned short op1, unsigned short op2);
+	void refresh(Chip8& core);
+	void scan(const Chip8& core, int from, int to);
+};
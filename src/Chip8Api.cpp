@@ -0,0 +1,155 @@
+#include "Chip8Api.h"
+#include "Chip8.h"
+#include "Debugger.h"
+
+struct chip8_machine {
+	Chip8 core;
+	Debugger debugger;
+	int breakpointCount; //Run the plain interpreter while this is 0
+	Chip8::Timing timing; //Put back after every initialize
+	chip8_registers registers;
+};
+
+namespace {
+	void syncRegisters(chip8_machine* machine) {
+		Chip8::DebugInfo info = machine->core.dumpDebug();
+		chip8_registers& r = machine->registers;
+		for (int i = 0; i < 16; i++) {
+			r.v[i] = info.V[i];
+			r.stack[i] = info.stack[i];
+		}
+		r.i = info.i;
+		r.pc = info.pc;
+		r.sp = info.sp;
+		r.delay_timer = (uint8_t)info.timer_delay;
+		r.sound_timer = (uint8_t)info.timer_sound;
+	}
+
+	/// <summary>
+	/// Run one instruction and collect its events
+	/// </summary>
+	/// <returns>false if a breakpoint stopped the machine and the batch should end</returns>
+	bool step(chip8_machine* machine, uint32_t& events) {
+		Chip8& core = machine->core;
+		bool sound = core.isSoundOn();
+
+		if (machine->breakpointCount > 0) {
+			if (!core.doCycle(machine->debugger)) {
+				events |= CHIP8_EVENT_BREAKPOINT;
+				return false;
+			}
+		}
+		else {
+			core.doCycle();
+		}
+
+		if (core.drawFlag) events |= CHIP8_EVENT_DREW;
+		if (core.isSoundOn() != sound) events |= sound ? CHIP8_EVENT_SOUND_OFF : CHIP8_EVENT_SOUND_ON;
+		//FX0A keeps running until a key comes, the timers count down meanwhile like the real machine
+		if (core.isWaitingForKey()) events |= CHIP8_EVENT_WAITING_KEY;
+		return true;
+	}
+
+	/// <summary>
+	/// Let the instruction we stopped on run when the host calls us again
+	/// </summary>
+	void resumeFromBreak(chip8_machine* machine) {
+		if (machine->debugger.isPaused()) machine->debugger.resume();
+	}
+}
+
+chip8_machine* chip8_create(void) {
+	chip8_machine* machine = new chip8_machine();
+	machine->breakpointCount = 0;
+	machine->timing = Chip8::Timing::Flat;
+	machine->core.initialize();
+	syncRegisters(machine);
+	return machine;
+}
+
+void chip8_destroy(chip8_machine* machine) {
+	delete machine;
+}
+
+void chip8_reset(chip8_machine* machine) {
+	machine->core.initialize();
+	machine->core.setTiming(machine->timing);
+	resumeFromBreak(machine);
+	syncRegisters(machine);
+}
+
+int chip8_load_rom(chip8_machine* machine, const uint8_t* data, size_t len) {
+	if (len > 4096 - 0x200) return -1;
+	machine->core.initialize();
+	machine->core.setTiming(machine->timing);
+	machine->core.loadProgram((const char*)data, (int)len);
+	resumeFromBreak(machine);
+	syncRegisters(machine);
+	return 0;
+}
+
+void chip8_seed(chip8_machine* machine, uint32_t seed) {
+	machine->core.seedRandom(seed);
+}
+
+void chip8_set_timing(chip8_machine* machine, int timing) {
+	machine->timing = timing == CHIP8_TIMING_VIP ? Chip8::Timing::Vip : Chip8::Timing::Flat;
+	machine->core.setTiming(machine->timing);
+}
+
+void chip8_set_keys(chip8_machine* machine, uint16_t keys) {
+	for (int i = 0; i < 16; i++) {
+		machine->core.setKey((unsigned char)i, (keys >> i) & 1);
+	}
+}
+
+uint32_t chip8_run_cycles(chip8_machine* machine, uint32_t cycles, uint32_t* ran) {
+	uint32_t events = 0;
+	unsigned long long start = machine->core.getCycles();
+
+	resumeFromBreak(machine);
+	for (uint32_t i = 0; i < cycles; i++) {
+		if (!step(machine, events)) break;
+	}
+
+	if (ran) *ran = (uint32_t)(machine->core.getCycles() - start);
+	syncRegisters(machine);
+	return events;
+}
+
+uint32_t chip8_run_frames(chip8_machine* machine, uint32_t frames, uint32_t* ran) {
+	uint32_t events = 0;
+	unsigned long long start = machine->core.getFrame();
+	unsigned long long target = start + frames;
+
+	resumeFromBreak(machine);
+	while (machine->core.getFrame() < target) {
+		if (!step(machine, events)) break;
+	}
+
+	if (ran) *ran = (uint32_t)(machine->core.getFrame() - start);
+	syncRegisters(machine);
+	return events;
+}
+
+const uint8_t* chip8_screen(const chip8_machine* machine) {
+	return machine->core.getScreen();
+}
+
+const chip8_registers* chip8_get_registers(const chip8_machine* machine) {
+	return &machine->registers;
+}
+
+uint64_t chip8_cycle_count(const chip8_machine* machine) {
+	return machine->core.getCycles();
+}
+
+uint64_t chip8_frame_count(const chip8_machine* machine) {
+	return machine->core.getFrame();
+}
+
+void chip8_set_breakpoint(chip8_machine* machine, uint16_t address, int enabled) {
+	if (machine->debugger.hasBreakpoint(address) == (enabled != 0)) return;
+	machine->debugger.toggleBreakpoint(address);
+	machine->breakpointCount += enabled ? 1 : -1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+/// <summary>
+/// C interface to the Chip-8 core
+/// ===================================================================================
+/// Stable C ABI for embedding the emulator in other hosts. Build the
+/// chip-8-lib project to get it as a shared library.
+///
+/// Run the machine in batches with chip8_run_cycles / chip8_run_frames so a
+/// host crosses the library boundary once per batch, not once per instruction.
+/// The screen and registers are read through pointers into the machine, no
+/// per frame copies.
+/// ===================================================================================
+/// </summary>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifdef CHIP8_BUILD_DLL
+#define CHIP8_API __declspec(dllexport)
+#else
+#define CHIP8_API __declspec(dllimport)
+#endif
+#else
+#define CHIP8_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_SCREEN_WIDTH 64
+#define CHIP8_SCREEN_HEIGHT 32
+//Bytes in the packed screen. 8 bytes per row, most significant bit is the leftmost pixel
+#define CHIP8_SCREEN_BYTES 256
+
+//Event bits returned by chip8_run_cycles / chip8_run_frames
+#define CHIP8_EVENT_DREW        0x01 //The screen changed
+#define CHIP8_EVENT_SOUND_ON    0x02 //The sound timer started
+#define CHIP8_EVENT_SOUND_OFF   0x04 //The sound timer ran out
+#define CHIP8_EVENT_WAITING_KEY 0x08 //FX0A was waiting for a key. Set the keys and run on
+#define CHIP8_EVENT_BREAKPOINT  0x10 //Stopped on a breakpoint
+
+//Timing models for chip8_set_timing
+#define CHIP8_TIMING_FLAT 0 //8 instructions per 60hz frame
+#define CHIP8_TIMING_VIP  1 //COSMAC VIP machine cycles, DXYN waits for the next frame
+
+typedef struct chip8_machine chip8_machine;
+
+typedef struct chip8_registers {
+	uint8_t v[16];
+	uint16_t i;
+	uint16_t pc;
+	uint16_t sp;
+	uint16_t stack[16];
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+} chip8_registers;
+
+CHIP8_API chip8_machine* chip8_create(void);
+CHIP8_API void chip8_destroy(chip8_machine* machine);
+
+/// <summary>
+/// Reset the machine and clear memory. The loaded ROM is gone after this
+/// </summary>
+CHIP8_API void chip8_reset(chip8_machine* machine);
+
+/// <summary>
+/// Reset the machine and load a ROM from memory
+/// </summary>
+/// <returns>0 on success, -1 if the ROM doesn't fit in memory</returns>
+CHIP8_API int chip8_load_rom(chip8_machine* machine, const uint8_t* data, size_t len);
+
+/// <summary>
+/// Seed the random number generator used by CXNN. Same seed and input, same run
+/// </summary>
+CHIP8_API void chip8_seed(chip8_machine* machine, uint32_t seed);
+
+/// <summary>
+/// Pick a CHIP8_TIMING_* model. Kept across reset and ROM loads.
+/// chip8_run_cycles still counts instructions, not machine cycles
+/// </summary>
+CHIP8_API void chip8_set_timing(chip8_machine* machine, int timing);
+
+/// <summary>
+/// Set the state of all 16 keys at once. Bit n is key n
+/// </summary>
+CHIP8_API void chip8_set_keys(chip8_machine* machine, uint16_t keys);
+
+/// <summary>
+/// Run up to cycles instructions. Stops early on a breakpoint. FX0A waiting
+/// for a key doesn't stop it, CHIP8_EVENT_WAITING_KEY tells the host
+/// </summary>
+/// <param name="ran">if not NULL, receives the number of instructions run</param>
+/// <returns>CHIP8_EVENT_* bits for everything that happened</returns>
+CHIP8_API uint32_t chip8_run_cycles(chip8_machine* machine, uint32_t cycles, uint32_t* ran);
+
+/// <summary>
+/// Run up to frames 60hz frames. Stops early like chip8_run_cycles, so
+/// without a breakpoint it always ends on a frame boundary
+/// </summary>
+/// <param name="ran">if not NULL, receives the number of frames completed</param>
+/// <returns>CHIP8_EVENT_* bits for everything that happened</returns>
+CHIP8_API uint32_t chip8_run_frames(chip8_machine* machine, uint32_t frames, uint32_t* ran);
+
+/// <summary>
+/// The packed screen, CHIP8_SCREEN_BYTES long. Points into the machine,
+/// valid until chip8_destroy and always current
+/// </summary>
+CHIP8_API const uint8_t* chip8_screen(const chip8_machine* machine);
+
+/// <summary>
+/// The registers. Valid until chip8_destroy, updated at the end of every
+/// run call, reset and ROM load
+/// </summary>
+CHIP8_API const chip8_registers* chip8_get_registers(const chip8_machine* machine);
+
+CHIP8_API uint64_t chip8_cycle_count(const chip8_machine* machine);
+CHIP8_API uint64_t chip8_frame_count(const chip8_machine* machine);
+
+/// <summary>
+/// Set or clear a breakpoint on an address. Machines without breakpoints
+/// run the interpreter with no debug checks at all
+/// </summary>
+CHIP8_API void chip8_set_breakpoint(chip8_machine* machine, uint16_t address, int enabled);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,467 @@
+#include "Chip8Batch.h"
+
+#define FONTSET_OFFSET 0x050
+
+//Everything that runs per step is written as masked arithmetic over all
+//LANES, with no branches on the mask, so the compiler can vectorize it
+namespace {
+	inline unsigned short widen(unsigned char mask) {
+		return (unsigned short)(0 - (mask & 1));
+	}
+
+	/// <summary>
+	/// a where mask is set, b where it isn't
+	/// </summary>
+	inline unsigned char pick(unsigned char mask, int a, unsigned char b) {
+		return ((unsigned char)a & mask) | (b & ~mask);
+	}
+	inline unsigned short pick(unsigned short mask, int a, unsigned short b) {
+		return ((unsigned short)a & mask) | (b & ~mask);
+	}
+	inline unsigned int pick(unsigned int mask, unsigned int a, unsigned int b) {
+		return (a & mask) | (b & ~mask);
+	}
+
+	/// <summary>
+	/// Bit for the 64 byte page an address is in
+	/// </summary>
+	inline unsigned long long pageBit(unsigned short address) {
+		return 1ULL << (address >> 6);
+	}
+}
+
+Chip8Batch::Chip8Batch(int lanes) {
+	if (lanes < 1) lanes = 1;
+	if (lanes > LANES) lanes = LANES;
+	this->lanes = lanes;
+
+	Chip8 blank;
+	blank.initialize();
+	loadAll(blank);
+	resetStats();
+}
+
+void Chip8Batch::resetStats() {
+	stats.steps = 0;
+	stats.laneCycles = 0;
+}
+
+void Chip8Batch::load(int lane, const Chip8& core) {
+	for (int r = 0; r < 16; r++) {
+		V[r][lane] = core.V[r];
+		stack[lane][r] = core.stack[r];
+	}
+	I[lane] = core.I;
+	pc[lane] = core.pc;
+	opcode[lane] = core.opcode;
+	delay_timer[lane] = core.delay_timer;
+	sound_timer[lane] = core.sound_timer;
+	//lanes always run Flat timing, from the same point in the frame
+	sleepTimer[lane] = (unsigned char)(core.sleepTimer * 8 / core.getTimePerFrame());
+	drawFlag[lane] = core.drawFlag;
+	keyWait[lane] = core.keyWait;
+	rng[lane] = core.rng;
+	frame[lane] = core.frame;
+	cycles[lane] = core.cycles;
+	sp[lane] = core.sp & 0x0f;
+
+	keys[lane] = 0;
+	for (int k = 0; k < 16; k++) {
+		if (core.key[k] != 0) keys[lane] |= 1 << k;
+	}
+
+	for (int i = 0; i < 32 * 8; i++) {
+		graphic[lane][i] = core.graphic[i];
+	}
+	tick[lane] = 0;
+
+	written[lane] = 0;
+	for (int i = 0; i < 4096; i++) {
+		memory[lane][i] = core.memory[i];
+		if (core.memory[i] != image[i]) written[lane] |= pageBit(i);
+	}
+	writtenAny |= written[lane];
+}
+
+void Chip8Batch::loadAll(const Chip8& core) {
+	for (int i = 0; i < 4096; i++) {
+		image[i] = core.memory[i];
+	}
+	writtenAny = 0;
+	for (int l = 0; l < LANES; l++) {
+		load(l, core);
+	}
+}
+
+void Chip8Batch::store(int lane, Chip8& core) const {
+	for (int r = 0; r < 16; r++) {
+		core.V[r] = V[r][lane];
+		core.stack[r] = stack[lane][r];
+		core.key[r] = (keys[lane] >> r) & 1;
+	}
+	core.I = I[lane];
+	core.pc = pc[lane];
+	core.opcode = opcode[lane];
+	core.delay_timer = delay_timer[lane];
+	core.sound_timer = sound_timer[lane];
+	core.sleepTimer = sleepTimer[lane];
+	core.timing = Chip8::Timing::Flat;
+	core.drawFlag = drawFlag[lane];
+	core.keyWait = keyWait[lane];
+	core.rng = rng[lane];
+	core.frame = frame[lane];
+	core.cycles = cycles[lane];
+	core.sp = sp[lane];
+
+	for (int i = 0; i < 32 * 8; i++) {
+		core.graphic[i] = graphic[lane][i];
+	}
+	for (int i = 0; i < 4096; i++) {
+		core.memory[i] = memory[lane][i];
+	}
+	//fused sequences are found again on the next runFrame
+	core.fusionFrom = 0;
+	core.fusionTo = 4095;
+	core.writtenFrom = 0;
+	core.writtenTo = 4095;
+}
+
+void Chip8Batch::setKeys(int lane, unsigned short keys) {
+	this->keys[lane] = keys;
+}
+
+unsigned int Chip8Batch::runFrame() {
+	unsigned char live[LANES];
+	unsigned int drew = 0;
+
+	for (int l = 0; l < LANES; l++) {
+		live[l] = l < lanes ? 0xff : 0;
+	}
+	//a lane stops once it ticks its timers
+	while (step(live, drew)) {
+		for (int l = 0; l < LANES; l++) {
+			live[l] &= ~tick[l];
+		}
+	}
+	return drew;
+}
+
+bool Chip8Batch::step(const unsigned char* live, unsigned int& drew) {
+	//lowest pc wins. lanes that jumped ahead wait for the rest to catch up
+	unsigned short at = 0xffff;
+	unsigned char any = 0;
+	for (int l = 0; l < LANES; l++) {
+		unsigned short lowest = pc[l] | (unsigned short)~widen(live[l]);
+		at = lowest < at ? lowest : at;
+		any |= live[l];
+	}
+	if (!any) return false;
+
+	int leader = 0;
+	while (!live[leader] || pc[leader] != at) leader++;
+
+	unsigned short hiAddress = at & 0x0fff;
+	unsigned short loAddress = (at + 1) & 0x0fff;
+	unsigned char hi = memory[leader][hiAddress];
+	unsigned char lo = memory[leader][loAddress];
+
+	unsigned char mask[LANES];
+	for (int l = 0; l < LANES; l++) {
+		mask[l] = live[l] & (pc[l] == at ? 0xff : 0);
+	}
+
+	//same pc isn't enough if a lane wrote over its own code. only lanes
+	//whose copy of these bytes may differ from the image need checking
+	unsigned long long pages = pageBit(hiAddress) | pageBit(loAddress);
+	if (writtenAny & pages) {
+		for (int l = 0; l < lanes; l++) {
+			if (mask[l] && (memory[l][hiAddress] != hi || memory[l][loAddress] != lo))
+				mask[l] = 0;
+		}
+	}
+
+	int count = 0;
+	for (int l = 0; l < LANES; l++) {
+		count += mask[l] & 1;
+	}
+	stats.steps++;
+	stats.laneCycles += count;
+
+	execute((unsigned short)(hi << 8 | lo), mask, drew);
+	return true;
+}
+
+void Chip8Batch::markWritten(int lane, unsigned short address, int length) {
+	for (int i = 0; i < length; i++) {
+		unsigned long long page = pageBit((address + i) & 0x0fff);
+		written[lane] |= page;
+		writtenAny |= page;
+	}
+}
+
+void Chip8Batch::execute(unsigned short op, const unsigned char* mask, unsigned int& drew) {
+	unsigned char x = (op & 0x0f00) >> 8;
+	unsigned char y = (op & 0x00f0) >> 4;
+	unsigned char n = (op & 0x000f);
+	unsigned char nn = (op & 0x00ff);
+	unsigned short nnn = (op & 0x0fff);
+
+	unsigned short mask16[LANES];
+	for (int l = 0; l < LANES; l++) {
+		mask16[l] = widen(mask[l]);
+	}
+
+	//fetch, drawFlag and the timers, the same as the start of Chip8::cycle
+	for (int l = 0; l < LANES; l++) {
+		unsigned char m = mask[l];
+		pc[l] += mask16[l] & 2;
+		opcode[l] = pick(mask16[l], op, opcode[l]);
+		drawFlag[l] &= ~m;
+		sleepTimer[l] = (sleepTimer[l] + (m & 1)) % 8;
+
+		tick[l] = m & (sleepTimer[l] == 0 ? 0xff : 0);
+		delay_timer[l] -= tick[l] & (delay_timer[l] > 0 ? 1 : 0);
+		sound_timer[l] -= tick[l] & (sound_timer[l] > 0 ? 1 : 0);
+		frame[l] += tick[l] & 1;
+		cycles[l] += m & 1;
+	}
+
+	switch ((op & 0xf000) >> 12) {
+	case 0x0:
+		if (nn == 0xe0) {
+			for (int l = 0; l < lanes; l++) {
+				if (!mask[l]) continue;
+				for (int i = 0; i < 32 * 8; i++) {
+					graphic[l][i] = 0;
+				}
+				drawFlag[l] = 1;
+				drew |= 1u << l;
+			}
+		}
+		else if (nn == 0xee) {
+			for (int l = 0; l < lanes; l++) {
+				if (!mask[l]) continue;
+				sp[l] = (sp[l] - 1) & 0x0f;
+				pc[l] = stack[l][sp[l]];
+			}
+		}
+		break;
+	case 0x1:
+		for (int l = 0; l < LANES; l++) {
+			pc[l] = pick(mask16[l], nnn, pc[l]);
+		}
+		break;
+	case 0x2:
+		for (int l = 0; l < lanes; l++) {
+			if (!mask[l]) continue;
+			stack[l][sp[l]] = pc[l];
+			sp[l] = (sp[l] + 1) & 0x0f;
+			pc[l] = nnn;
+		}
+		break;
+	case 0x3:
+		for (int l = 0; l < LANES; l++) {
+			pc[l] += mask16[l] & (V[x][l] == nn ? 2 : 0);
+		}
+		break;
+	case 0x4:
+		for (int l = 0; l < LANES; l++) {
+			pc[l] += mask16[l] & (V[x][l] != nn ? 2 : 0);
+		}
+		break;
+	case 0x5:
+		for (int l = 0; l < LANES; l++) {
+			pc[l] += mask16[l] & (V[x][l] == V[y][l] ? 2 : 0);
+		}
+		break;
+	case 0x6:
+		for (int l = 0; l < LANES; l++) {
+			V[x][l] = pick(mask[l], nn, V[x][l]);
+		}
+		break;
+	case 0x7:
+		for (int l = 0; l < LANES; l++) {
+			V[x][l] += mask[l] & nn;
+		}
+		break;
+	case 0x8:
+		//VF is written before VX and read again after, like Chip8 does, so X or Y = F give the same result
+		switch (n) {
+		case 0x0:
+			for (int l = 0; l < LANES; l++) {
+				V[x][l] = pick(mask[l], V[y][l], V[x][l]);
+			}
+			break;
+		case 0x1:
+			for (int l = 0; l < LANES; l++) {
+				V[x][l] |= mask[l] & V[y][l];
+			}
+			break;
+		case 0x2:
+			for (int l = 0; l < LANES; l++) {
+				V[x][l] &= ~mask[l] | V[y][l];
+			}
+			break;
+		case 0x3:
+			for (int l = 0; l < LANES; l++) {
+				V[x][l] ^= mask[l] & V[y][l];
+			}
+			break;
+		case 0x4:
+			for (int l = 0; l < LANES; l++) {
+				unsigned char m = mask[l];
+				V[0xf][l] = pick(m, V[x][l] + V[y][l] > 0xff, V[0xf][l]);
+				V[x][l] += m & V[y][l];
+			}
+			break;
+		case 0x5:
+			for (int l = 0; l < LANES; l++) {
+				unsigned char m = mask[l];
+				V[0xf][l] = pick(m, V[x][l] > V[y][l], V[0xf][l]);
+				V[x][l] -= m & V[y][l];
+			}
+			break;
+		case 0x6:
+			for (int l = 0; l < LANES; l++) {
+				unsigned char m = mask[l];
+				V[0xf][l] = pick(m, V[x][l] & 0x01, V[0xf][l]);
+				V[x][l] = pick(m, V[x][l] >> 1, V[x][l]);
+			}
+			break;
+		case 0x7:
+			for (int l = 0; l < LANES; l++) {
+				unsigned char m = mask[l];
+				V[0xf][l] = pick(m, V[y][l] > V[x][l], V[0xf][l]);
+				V[x][l] = pick(m, V[y][l] - V[x][l], V[x][l]);
+			}
+			break;
+		case 0xe:
+			for (int l = 0; l < LANES; l++) {
+				unsigned char m = mask[l];
+				V[0xf][l] = pick(m, V[x][l] & 0x80, V[0xf][l]);
+				V[x][l] = pick(m, V[x][l] << 1, V[x][l]);
+			}
+			break;
+		}
+		break;
+	case 0x9:
+		for (int l = 0; l < LANES; l++) {
+			pc[l] += mask16[l] & (V[x][l] != V[y][l] ? 2 : 0);
+		}
+		break;
+	case 0xa:
+		for (int l = 0; l < LANES; l++) {
+			I[l] = pick(mask16[l], nnn, I[l]);
+		}
+		break;
+	case 0xb:
+		for (int l = 0; l < LANES; l++) {
+			pc[l] = pick(mask16[l], nnn + V[0][l], pc[l]);
+		}
+		break;
+	case 0xc:
+		//xorshift32, same as Chip8::nextRandom
+		for (int l = 0; l < LANES; l++) {
+			unsigned int r = rng[l];
+			r ^= r << 13;
+			r ^= r >> 17;
+			r ^= r << 5;
+			rng[l] = pick((unsigned int)0 - (mask[l] & 1), r, rng[l]);
+			V[x][l] = pick(mask[l], (unsigned char)(r & nn), V[x][l]);
+		}
+		break;
+	case 0xd:
+		for (int l = 0; l < lanes; l++) {
+			if (!mask[l]) continue;
+			bool collision = Chip8::drawSprite(graphic[l], memory[l], I[l], V[x][l], V[y][l], n);
+			V[0xf][l] = collision ? 1 : 0;
+			drawFlag[l] = 1;
+			drew |= 1u << l;
+		}
+		break;
+	case 0xe:
+		if (nn == 0x9e) {
+			for (int l = 0; l < LANES; l++) {
+				bool pressed = (keys[l] >> (V[x][l] & 0x0f)) & 1;
+				pc[l] += mask16[l] & (pressed ? 2 : 0);
+			}
+		}
+		else if (nn == 0xa1) {
+			for (int l = 0; l < LANES; l++) {
+				bool pressed = (keys[l] >> (V[x][l] & 0x0f)) & 1;
+				pc[l] += mask16[l] & (pressed ? 0 : 2);
+			}
+		}
+		break;
+	case 0xf:
+		switch (nn) {
+		case 0x07:
+			for (int l = 0; l < LANES; l++) {
+				V[x][l] = pick(mask[l], delay_timer[l], V[x][l]);
+			}
+			break;
+		case 0x0a:
+			for (int l = 0; l < lanes; l++) {
+				if (!mask[l]) continue;
+				if (keys[l] == 0) {
+					keyWait[l] = 1;
+					pc[l] -= 2;
+					continue;
+				}
+				unsigned char k = 0;
+				while (((keys[l] >> k) & 1) == 0) k++;
+				V[x][l] = k;
+				keyWait[l] = 0;
+			}
+			break;
+		case 0x15:
+			for (int l = 0; l < LANES; l++) {
+				delay_timer[l] = pick(mask[l], V[x][l], delay_timer[l]);
+			}
+			break;
+		case 0x18:
+			for (int l = 0; l < LANES; l++) {
+				sound_timer[l] = pick(mask[l], V[x][l], sound_timer[l]);
+			}
+			break;
+		case 0x1e:
+			for (int l = 0; l < LANES; l++) {
+				I[l] += mask16[l] & V[x][l];
+			}
+			break;
+		case 0x29:
+			for (int l = 0; l < LANES; l++) {
+				I[l] = pick(mask16[l], FONTSET_OFFSET + 5 * V[x][l], I[l]);
+			}
+			break;
+		case 0x33:
+			for (int l = 0; l < lanes; l++) {
+				if (!mask[l]) continue;
+				unsigned char vx = V[x][l];
+				memory[l][I[l] & 0x0fff] = vx / 100;
+				memory[l][(I[l] + 1) & 0x0fff] = (vx / 10) % 10;
+				memory[l][(I[l] + 2) & 0x0fff] = vx % 10;
+				markWritten(l, I[l], 3);
+			}
+			break;
+		case 0x55:
+			for (int l = 0; l < lanes; l++) {
+				if (!mask[l]) continue;
+				for (int i = 0; i <= x; i++) {
+					memory[l][(I[l] + i) & 0x0fff] = V[i][l];
+				}
+				markWritten(l, I[l], x + 1);
+			}
+			break;
+		case 0x65:
+			for (int l = 0; l < lanes; l++) {
+				if (!mask[l]) continue;
+				for (int i = 0; i <= x; i++) {
+					V[i][l] = memory[l][(I[l] + i) & 0x0fff];
+				}
+			}
+			break;
+		}
+		break;
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "Chip8.h"
+
+/// <summary>
+/// Many Chip8 machines run in lockstep
+/// ===================================================================================
+/// For input search and training, where the same ROM runs many times with
+/// different input. Each machine is a lane. Registers, I, pc and the timers
+/// are stored lane by lane (V[register][lane] and so on) so one instruction
+/// is applied to every lane with plain loops over LANES that the compiler
+/// turns into SSE/AVX code.
+///
+/// Every step picks the lowest pc among the lanes still running, and every
+/// lane at that pc with the same opcode runs it together. The others are
+/// masked off and wait. Lanes that branched apart get grouped again as soon
+/// as their pcs meet, which for most games is the top of the main loop.
+///
+/// Memory, the screen and the stack are per lane and only touched by the
+/// instructions that need them (DXYN, FX33, FX55, FX65, 2NNN, 00EE).
+/// Lanes are expected to share a ROM, so the batch keeps the memory image
+/// from loadAll() and tracks which pages each lane has written since.
+///
+/// Each lane behaves exactly like a Chip8 running runFrame() with the same
+/// input. load() and store() move machines in and out. Lanes always use
+/// Flat timing, a machine loaded with Vip timing comes back out with Flat.
+/// ===================================================================================
+/// </summary>
+class Chip8Batch
+{
+public:
+	static const int LANES = 32;
+
+	/// <param name="lanes">number of lanes in use, 1 - LANES</param>
+	Chip8Batch(int lanes);
+
+	int getLanes() const { return lanes; }
+
+	/// <summary>
+	/// Copy a machine into a lane
+	/// </summary>
+	void load(int lane, const Chip8& core);
+	/// <summary>
+	/// Copy a machine into every lane
+	/// </summary>
+	void loadAll(const Chip8& core);
+	/// <summary>
+	/// Copy a lane back out to a machine
+	/// </summary>
+	void store(int lane, Chip8& core) const;
+
+	/// <summary>
+	/// Set the keypad of a lane. Bit n is key n
+	/// </summary>
+	void setKeys(int lane, unsigned short keys);
+
+	/// <summary>
+	/// Run every lane until its next 60hz timer tick
+	/// </summary>
+	/// <returns>bit n set if lane n drew anything during the frame</returns>
+	unsigned int runFrame();
+
+	/// <summary>
+	/// Packed screen of a lane, same layout as Chip8::getScreen()
+	/// </summary>
+	const unsigned char* getScreen(int lane) const { return graphic[lane]; }
+	unsigned long long getFrame(int lane) const { return frame[lane]; }
+
+	struct Stats {
+		unsigned long long steps; //Instructions issued to the whole batch
+		unsigned long long laneCycles; //Instructions run summed over all lanes
+	};
+	/// <summary>
+	/// laneCycles / (steps * lanes) is how well the lanes stay together.
+	/// 1 means they never diverged
+	/// </summary>
+	const Stats& getStats() const { return stats; }
+	void resetStats();
+
+private:
+	int lanes;
+
+	//Lane by lane state. index is [register][lane] or [lane]
+	unsigned char V[16][LANES];
+	unsigned short I[LANES];
+	unsigned short pc[LANES];
+	unsigned short opcode[LANES];
+	unsigned char delay_timer[LANES];
+	unsigned char sound_timer[LANES];
+	unsigned char sleepTimer[LANES];
+	unsigned char drawFlag[LANES];
+	unsigned char keyWait[LANES];
+	unsigned short keys[LANES];
+	unsigned int rng[LANES];
+	unsigned long long frame[LANES];
+	unsigned long long cycles[LANES];
+	unsigned char tick[LANES]; //0xff for lanes whose timers ticked on the last step
+
+	//Per lane state only touched by scalar code
+	unsigned short sp[LANES];
+	unsigned short stack[LANES][16];
+	unsigned char graphic[LANES][32 * 8];
+	unsigned char memory[LANES][4096];
+
+	//Memory every lane started from. A lane's copy only differs from it
+	//in pages whose bit is set in written, so lanes only need their opcode
+	//compared against the leader's when one of them wrote to that page
+	unsigned char image[4096];
+	unsigned long long written[LANES]; //1 bit per 64 byte page
+	unsigned long long writtenAny;
+
+	Stats stats;
+
+	/// <summary>
+	/// Run one instruction on every live lane that is at the lowest pc
+	/// </summary>
+	/// <param name="live">0xff for lanes allowed to run, 0 otherwise</param>
+	/// <param name="drew">bit n gets set if lane n ran a DXYN or 00E0</param>
+	/// <returns>false if no lane was live</returns>
+	bool step(const unsigned char* live, unsigned int& drew);
+	void execute(unsigned short op, const unsigned char* mask, unsigned int& drew);
+	void markWritten(int lane, unsigned short address, int length);
+};
@@ -0,0 +1,227 @@
+#include "CompactChip8.h"
+#include <algorithm>
+#include <string.h>
+
+namespace {
+	/// <summary>
+	/// Mix a block of memory into a hash 8 bytes at a time. Several times
+	/// faster than the byte at a time FNV-1a of Chip8::hash(), and the
+	/// explorer hashes every state it reaches
+	/// </summary>
+	unsigned long long mix(unsigned long long h, const void* data, int len) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (; len > 0; len -= 8, bytes += 8) {
+			unsigned long long word = 0;
+			memcpy(&word, bytes, len < 8 ? len : 8);
+			h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+			h ^= h >> 29;
+		}
+		return h;
+	}
+
+	/// <summary>
+	/// One stored page's share of pageHash
+	/// </summary>
+	unsigned long long hashPage(unsigned short index, const unsigned char* bytes) {
+		unsigned long long h = mix(0xcbf29ce484222325ULL ^ index, bytes, CompactChip8::PAGE_SIZE);
+		//pages are summed, so each needs all of its bits mixed
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+}
+
+unsigned long long CompactChip8::hash() const {
+	//registers packed together first, the padding between them is never written
+	unsigned char regs[64];
+	unsigned char* at = regs;
+	memcpy(at, V, sizeof(V)); at += sizeof(V);
+	memcpy(at, stack, sizeof(stack)); at += sizeof(stack);
+	memcpy(at, &I, sizeof(I)); at += sizeof(I);
+	memcpy(at, &pc, sizeof(pc)); at += sizeof(pc);
+	memcpy(at, &sp, sizeof(sp)); at += sizeof(sp);
+	memcpy(at, &sleepTimer, sizeof(sleepTimer)); at += sizeof(sleepTimer);
+	memcpy(at, &rng, sizeof(rng)); at += sizeof(rng);
+	*at++ = delay_timer;
+	*at++ = sound_timer;
+	*at++ = keyWait;
+	*at++ = (unsigned char)timing;
+
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	h = mix(h, regs, (int)(at - regs));
+	h = mix(h, graphic, sizeof(graphic));
+	h = mix(h, &pageHash, sizeof(pageHash));
+
+	//spread the last words into the low bits, which pick the slot in a hash table
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+CompactRunner::CompactRunner(const Chip8& core) : image(core) {
+	//both tables match memory from here on
+	imageFusion.refresh(image);
+	scratch = image;
+	fusion = imageFusion;
+}
+
+void CompactRunner::loadRegisters(const CompactChip8& in, Chip8& core) const {
+	for (int r = 0; r < 16; r++) {
+		core.V[r] = in.V[r];
+		core.stack[r] = in.stack[r];
+		core.key[r] = (in.keys >> r) & 1;
+	}
+	core.I = in.I;
+	core.pc = in.pc;
+	core.opcode = in.opcode;
+	core.sp = in.sp;
+	core.delay_timer = in.delay_timer;
+	core.sound_timer = in.sound_timer;
+	core.sleepTimer = in.sleepTimer;
+	core.timing = in.timing;
+	core.keyWait = in.keyWait;
+	core.drawFlag = in.drawFlag;
+	core.rng = in.rng;
+	core.frame = in.frame;
+	core.cycles = in.cycles;
+	memcpy(core.graphic, in.graphic, sizeof(in.graphic));
+}
+
+void CompactRunner::storeRegisters(const Chip8& core, CompactChip8& out) const {
+	out.keys = 0;
+	for (int r = 0; r < 16; r++) {
+		out.V[r] = core.V[r];
+		out.stack[r] = core.stack[r];
+		if (core.key[r] != 0) out.keys |= 1 << r;
+	}
+	out.I = core.I;
+	out.pc = core.pc;
+	out.opcode = core.opcode;
+	out.sp = core.sp;
+	out.delay_timer = core.delay_timer;
+	out.sound_timer = core.sound_timer;
+	out.sleepTimer = core.sleepTimer;
+	out.timing = core.timing;
+	out.keyWait = core.keyWait;
+	out.drawFlag = core.drawFlag;
+	out.rng = core.rng;
+	out.frame = core.frame;
+	out.cycles = core.cycles;
+	memcpy(out.graphic, core.graphic, sizeof(core.graphic));
+}
+
+void CompactRunner::pack(const Chip8& core, CompactChip8& out) const {
+	const int size = CompactChip8::PAGE_SIZE;
+	storeRegisters(core, out);
+	out.pages.clear();
+	out.pageHash = 0;
+	for (int index = 0; index < 4096 / size; index++) {
+		if (memcmp(&core.memory[index * size], &image.memory[index * size], size) == 0) continue;
+		CompactChip8::Page page;
+		page.index = (unsigned short)index;
+		memcpy(page.bytes, &core.memory[index * size], size);
+		out.pages.push_back(page);
+		out.pageHash += hashPage(page.index, page.bytes);
+	}
+}
+
+void CompactRunner::unpack(const CompactChip8& in, Chip8& core) const {
+	core = image;
+	loadRegisters(in, core);
+	for (const CompactChip8::Page& page : in.pages) {
+		memcpy(&core.memory[page.index * CompactChip8::PAGE_SIZE], page.bytes, CompactChip8::PAGE_SIZE);
+	}
+	//fused sequences are found again on the next runFrame
+	core.fusionFrom = 0;
+	core.fusionTo = 4095;
+	core.writtenFrom = 0;
+	core.writtenTo = 4095;
+}
+
+/// <summary>
+/// Bring the pages of the state covering two addresses in line with the
+/// scratch memory. Pages equal to the image are dropped, the rest are added
+/// or updated
+/// </summary>
+void CompactRunner::storePages(CompactChip8& state, int from, int to) const {
+	const int size = CompactChip8::PAGE_SIZE;
+	if (from < 0) from = 0;
+	if (to > 4095) to = 4095;
+
+	std::vector<CompactChip8::Page>& pages = state.pages;
+	for (int index = from / size; index <= to / size; index++) {
+		const unsigned char* now = &scratch.memory[index * size];
+		bool same = memcmp(now, &image.memory[index * size], size) == 0;
+
+		std::vector<CompactChip8::Page>::iterator at = std::lower_bound(pages.begin(), pages.end(), index,
+			[](const CompactChip8::Page& page, int index) { return page.index < index; });
+		bool stored = at != pages.end() && at->index == index;
+
+		if (same) {
+			if (!stored) continue;
+			state.pageHash -= hashPage(at->index, at->bytes);
+			pages.erase(at);
+		} else {
+			if (!stored) {
+				at = pages.insert(at, CompactChip8::Page());
+				at->index = (unsigned short)index;
+			}
+			else if (memcmp(at->bytes, now, size) == 0) continue;
+			else state.pageHash -= hashPage(at->index, at->bytes);
+			memcpy(at->bytes, now, size);
+			state.pageHash += hashPage(at->index, at->bytes);
+		}
+	}
+}
+
+/// <summary>
+/// Put scratch memory between two addresses back to the image,
+/// with the fused sequences that can reach into it
+/// </summary>
+void CompactRunner::revert(int from, int to) {
+	if (from < 0) from = 0;
+	if (to > 4095) to = 4095;
+	memcpy(&scratch.memory[from], &image.memory[from], to - from + 1);
+
+	int fusedFrom = std::max(from - 5, 0) >> 1;
+	memcpy(&fusion.kinds[fusedFrom], &imageFusion.kinds[fusedFrom], (to >> 1) - fusedFrom + 1);
+}
+
+bool CompactRunner::runFrame(CompactChip8& state) {
+	return run(state, nullptr, nullptr);
+}
+
+bool CompactRunner::runFrame(CompactChip8& state, unsigned char* visited, int& newlyVisited) {
+	return run(state, visited, &newlyVisited);
+}
+
+bool CompactRunner::run(CompactChip8& state, unsigned char* visited, int* newlyVisited) {
+	const int size = CompactChip8::PAGE_SIZE;
+
+	for (const CompactChip8::Page& page : state.pages) {
+		memcpy(&scratch.memory[page.index * size], page.bytes, size);
+		fusion.scan(scratch, page.index * size - 5, page.index * size + size - 1);
+	}
+	loadRegisters(state, scratch);
+
+	scratch.writtenFrom = 4096;
+	scratch.writtenTo = -1;
+	bool drew = visited ? scratch.runFrame(visited, *newlyVisited) : scratch.runFrame(fusion);
+
+	storeRegisters(scratch, state);
+	int from = scratch.writtenFrom;
+	int to = scratch.writtenTo;
+	if (from <= to) storePages(state, from, to);
+
+	//every page that differs from the image is either still stored or was written
+	for (const CompactChip8::Page& page : state.pages) {
+		revert(page.index * size, page.index * size + size - 1);
+	}
+	if (from <= to) revert(from, to);
+	scratch.fusionFrom = 4096;
+	scratch.fusionTo = -1;
+
+	return drew;
+}
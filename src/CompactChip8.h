@@ -0,0 +1,120 @@
+#pragma once
+#include "Chip8.h"
+#include <vector>
+
+/// <summary>
+/// A machine stored as only what differs from its ROM
+/// ===================================================================================
+/// For running a very large number of machines of one ROM. A Chip8 is over
+/// 4KB, almost all of it memory, and nearly all of that is the same font
+/// and program bytes in every copy.
+/// CompactChip8 keeps the registers, timers, stack and packed screen, and
+/// memory only as the 16 byte pages that differ from the shared image.
+/// That is about 380 bytes, plus 18 for each page the program has written
+/// with FX33 or FX55. A page that is written back to what the image holds
+/// stops being stored.
+///
+/// CompactRunner owns the shared image and runs machines one at a time on
+/// a scratch Chip8: it copies the machine's pages and registers in, runs
+/// the frame, keeps the pages that were written and puts the scratch memory
+/// back to the image. Running a frame behaves exactly like Chip8::runFrame().
+/// A runner is not thread safe, use one per thread. They can share machines
+/// as long as each machine is only run by one at a time.
+/// ===================================================================================
+/// </summary>
+class CompactChip8
+{
+	friend class CompactRunner;
+public:
+	static const int PAGE_SIZE = 16;
+
+	/// <summary>
+	/// Set the keypad. Bit n is key n
+	/// </summary>
+	void setKeys(unsigned short keys) { this->keys = keys; }
+	unsigned short getKeys() const { return keys; }
+
+	/// <summary>
+	/// The screen, same layout as Chip8::getScreen()
+	/// </summary>
+	const unsigned char* getScreen() const { return graphic; }
+	unsigned long long getFrame() const { return frame; }
+	unsigned long long getCycles() const { return cycles; }
+	/// <summary>
+	/// Number of pages stored because they differ from the image
+	/// </summary>
+	int getPageCount() const { return (int)pages.size(); }
+
+	/// <summary>
+	/// Hash of everything that affects how the machine runs from here on,
+	/// except the keys. Only the stored pages are hashed, so it is only
+	/// comparable between machines of the same runner
+	/// </summary>
+	unsigned long long hash() const;
+
+private:
+	struct Page {
+		unsigned short index; //Address / PAGE_SIZE
+		unsigned char bytes[PAGE_SIZE];
+	};
+	std::vector<Page> pages; //Sorted by index
+	//Sum of every stored page's hash. Kept up to date as pages are stored,
+	//so hash() doesn't go through the pages again
+	unsigned long long pageHash;
+
+	unsigned char V[16];
+	unsigned short I;
+	unsigned short pc;
+	unsigned short opcode;
+	unsigned short stack[16];
+	unsigned short sp;
+	unsigned char delay_timer;
+	unsigned char sound_timer;
+	unsigned short sleepTimer;
+	Chip8::Timing timing;
+	unsigned char keyWait;
+	unsigned char drawFlag;
+	unsigned short keys;
+	unsigned int rng;
+	unsigned long long frame;
+	unsigned long long cycles;
+	unsigned char graphic[32 * 8];
+};
+
+class CompactRunner
+{
+public:
+	/// <param name="core">machine whose memory is shared, usually one straight after loadProgram()</param>
+	CompactRunner(const Chip8& core);
+
+	/// <summary>
+	/// Store a machine against this runner's image
+	/// </summary>
+	void pack(const Chip8& core, CompactChip8& out) const;
+	/// <summary>
+	/// Rebuild the full machine
+	/// </summary>
+	void unpack(const CompactChip8& in, Chip8& core) const;
+
+	/// <summary>
+	/// Run a machine until its next 60hz timer tick
+	/// </summary>
+	/// <returns>true if anything was drawn during the frame</returns>
+	bool runFrame(CompactChip8& state);
+	/// <summary>
+	/// Same, recording coverage like Chip8::runFrame(visited, newlyVisited)
+	/// </summary>
+	bool runFrame(CompactChip8& state, unsigned char* visited, int& newlyVisited);
+
+private:
+	Chip8 image;
+	FusionTable imageFusion;
+	Chip8 scratch; //Memory equals image's between frames
+	FusionTable fusion; //Matches scratch's memory, so equals imageFusion between frames
+
+	void loadRegisters(const CompactChip8& in, Chip8& core) const;
+	void storeRegisters(const Chip8& core, CompactChip8& out) const;
+	void storePages(CompactChip8& state, int from, int to) const;
+	void revert(int from, int to);
+	bool run(CompactChip8& state, unsigned char* visited, int* newlyVisited);
+};
@@ -0,0 +1,611 @@
+#include "CoreTests.h"
+#include "Chip8Batch.h"
+#include "CompactChip8.h"
+#include "Explorer.h"
+#include "SharedFrames.h"
+#include <memory>
+#include <thread>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGRAM_OFFSET 0x200
+//Instructions in a random ROM, then a subroutine
+#define TEST_ROM_OPS 240
+
+namespace {
+	/// <summary>
+	/// xorshift32, so a check always runs the same ROMs and input
+	/// </summary>
+	struct Random {
+		unsigned int state;
+
+		unsigned int next() {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+	};
+
+	/// <summary>
+	/// Append one random instruction, or a short sequence runFrame fuses
+	/// </summary>
+	void appendRandomOp(Random& random, std::vector<unsigned short>& ops) {
+		//VD holds the key EX9E and EXA1 test, so it only gets set to 0 - F
+		unsigned short x = random.next() % 15;
+		if (x == 0xd) x = 0xf;
+		unsigned short y = random.next() % 16;
+		unsigned short nn = random.next() % 256;
+		unsigned short target = PROGRAM_OFFSET + 2 * (random.next() % TEST_ROM_OPS);
+		unsigned short data = 0x600 + random.next() % 0x9f0; //Past the code, up to the end of memory
+		unsigned short here = PROGRAM_OFFSET + 2 * (unsigned short)ops.size();
+
+		switch (random.next() % 34) {
+		case 0: ops.push_back(0x00e0); break;
+		case 1: ops.push_back(0x1000 | target); break;
+		case 2: ops.push_back(0x3000 | x << 8 | nn); break;
+		case 3: ops.push_back(0x4000 | x << 8 | nn); break;
+		case 4: ops.push_back(0x5000 | x << 8 | y << 4); break;
+		case 5: ops.push_back(0x6000 | x << 8 | nn); break;
+		case 6: ops.push_back(0x7000 | x << 8 | nn); break;
+		case 7: {
+			static const unsigned short kinds[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xe };
+			ops.push_back(0x8000 | x << 8 | y << 4 | kinds[random.next() % 9]);
+			break;
+		}
+		case 8: ops.push_back(0x9000 | x << 8 | y << 4); break;
+		case 9: ops.push_back(0xa000 | data); break;
+		case 10: ops.push_back(0xc000 | x << 8 | nn); break;
+		case 11: ops.push_back(0xd000 | x << 8 | y << 4 | (random.next() % 16)); break;
+		case 12: ops.push_back(0x6d00 | (nn & 0x0f)); break;
+		case 13: ops.push_back(0xed9e); break;
+		case 14: ops.push_back(0xeda1); break;
+		case 15: ops.push_back(0xf007 | x << 8); break;
+		case 16: ops.push_back(0xf00a | x << 8); break;
+		case 17: ops.push_back(0xf015 | x << 8); break;
+		case 18: ops.push_back(0xf018 | x << 8); break;
+		case 19: ops.push_back(0xf01e | x << 8); break; //Can take I past 0xFFF
+		case 20: ops.push_back(0xf029 | x << 8); break;
+		case 21: ops.push_back(0xf033 | x << 8); break;
+		case 22: ops.push_back(0xf055 | x << 8); break;
+		case 23: ops.push_back(0xf065 | (x % 13) << 8); break; //Leaves VD alone
+		//calls that overflow the stack and returns that underflow it
+		case 24: ops.push_back(0x2000 | (PROGRAM_OFFSET + 2 * TEST_ROM_OPS)); break;
+		case 25: ops.push_back(random.next() % 4 == 0 ? 0x2000 | target : 0x00ee); break;
+		case 26: ops.push_back(0xb000 | (random.next() % 2 == 0 ? target : 0xff0)); break;
+		//the sequences runFrame fuses
+		case 27:
+			ops.push_back(0xa000 | data);
+			ops.push_back(0xd000 | x << 8 | y << 4 | (random.next() % 16));
+			break;
+		case 28:
+			ops.push_back(0x6000 | x << 8 | nn);
+			ops.push_back((random.next() % 2 == 0 ? 0xf015 : 0xf018) | x << 8);
+			break;
+		case 29:
+			ops.push_back(0xf007 | x << 8);
+			ops.push_back(0x3000 | x << 8);
+			ops.push_back(0x1000 | (random.next() % 2 == 0 ? here : target));
+			break;
+		case 30:
+			ops.push_back(0x7000 | x << 8 | nn);
+			ops.push_back(0x3000 | x << 8 | (random.next() % 256));
+			ops.push_back(0x1000 | (random.next() % 2 == 0 ? here : target));
+			break;
+		case 31:
+			ops.push_back(0xf029 | x << 8);
+			ops.push_back(0xd005 | x << 8 | y << 4);
+			break;
+		//code that rewrites itself
+		case 32:
+			ops.push_back(0xa000 | target);
+			ops.push_back((random.next() % 2 == 0 ? 0xf033 : 0xf055) | x << 8);
+			break;
+		//code that writes a sequence runFrame fuses over other code
+		case 33:
+			ops.push_back(0x60a3);
+			ops.push_back(0x6100);
+			ops.push_back(0x62d0 | (random.next() % 16) << 4);
+			ops.push_back(0x6300 | (random.next() % 16));
+			ops.push_back(0xa000 | target);
+			ops.push_back(0xf355);
+			break;
+		default:
+			ops.push_back(0x1000 | target);
+			break;
+		}
+	}
+
+	unsigned short randomKeys(Random& random) {
+		switch (random.next() % 6) {
+		case 0:
+		case 1:
+			return 0;
+		case 2:
+			return 0xffff;
+		default:
+			return (unsigned short)(1 << (random.next() % 16));
+		}
+	}
+
+	void setKeys(Chip8& core, unsigned short keys) {
+		for (int i = 0; i < 16; i++) {
+			core.setKey((unsigned char)i, (keys >> i) & 1);
+		}
+	}
+
+	/// <summary>
+	/// runFrame() the plain way, one instruction at a time with no fused sequences
+	/// </summary>
+	bool stepFrame(Chip8& core) {
+		bool drew = false;
+		unsigned long long target = core.getFrame() + 1;
+		while (core.getFrame() < target) {
+			core.doCycle();
+			if (core.drawFlag) drew = true;
+		}
+		return drew;
+	}
+
+	bool sameMachine(const Chip8& a, const Chip8& b) {
+		return a.hash() == b.hash() && a.getCycles() == b.getCycles() && a.getFrame() == b.getFrame()
+			&& a.isWaitingForKey() == b.isWaitingForKey();
+	}
+
+	/// <summary>
+	/// Report where a check first went wrong
+	/// </summary>
+	void reportMismatch(std::string& report, const char* what, int machine, int frame, Chip8& got, Chip8& expected) {
+		Chip8::DebugInfo a = got.dumpDebug();
+		Chip8::DebugInfo b = expected.dumpDebug();
+		char buf[256];
+		snprintf(buf, sizeof(buf),
+			"FAIL: %s, machine %d, frame %d\n"
+			"got      pc %03X op %04X I %03X sp %X cycles %llu\n"
+			"expected pc %03X op %04X I %03X sp %X cycles %llu\n",
+			what, machine, frame,
+			a.pc, a.opcode, a.i, a.sp, got.getCycles(),
+			b.pc, b.opcode, b.i, b.sp, expected.getCycles());
+		report = buf;
+	}
+}
+
+std::vector<Chip8> makeTestMachines(int count, unsigned int seed) {
+	Random random = { seed != 0 ? seed : 1 };
+	std::vector<Chip8> machines(count);
+
+	for (Chip8& machine : machines) {
+		std::vector<unsigned short> ops;
+		while (ops.size() < TEST_ROM_OPS - 3) {
+			appendRandomOp(random, ops);
+		}
+		while (ops.size() < TEST_ROM_OPS) {
+			ops.push_back(0x1000 | PROGRAM_OFFSET);
+		}
+		//the subroutine case 24 calls
+		ops.push_back(0x7e01);
+		ops.push_back(0x00ee);
+
+		std::vector<char> rom;
+		for (unsigned short op : ops) {
+			rom.push_back((char)(op >> 8));
+			rom.push_back((char)(op & 0xff));
+		}
+		machine.initialize();
+		machine.loadProgram(rom.data(), (int)rom.size());
+		machine.seedRandom(random.next());
+	}
+	return machines;
+}
+
+bool runBatchTest(const std::vector<Chip8>& machines, int frames, std::string& report) {
+	Random random = { 0x5eed0033 };
+	const int lanes = Chip8Batch::LANES;
+	//too big for the stack
+	std::unique_ptr<Chip8Batch> batch(new Chip8Batch(lanes));
+	std::vector<Chip8> expected(lanes);
+	Chip8 got;
+	unsigned long long steps = 0;
+	unsigned long long laneCycles = 0;
+
+	for (int m = 0; m < (int)machines.size(); m++) {
+		Chip8 start = machines[m];
+		start.setTiming(Chip8::Timing::Flat);
+		batch->loadAll(start);
+		batch->resetStats();
+		for (int l = 0; l < lanes; l++) {
+			expected[l] = start;
+		}
+
+		for (int f = 0; f < frames; f++) {
+			for (int l = 0; l < lanes; l++) {
+				unsigned short keys = randomKeys(random);
+				batch->setKeys(l, keys);
+				setKeys(expected[l], keys);
+			}
+
+			unsigned int drew = batch->runFrame();
+			for (int l = 0; l < lanes; l++) {
+				bool expectedDrew = stepFrame(expected[l]);
+				batch->store(l, got);
+				if (!sameMachine(got, expected[l]) || expectedDrew != (((drew >> l) & 1) != 0)) {
+					reportMismatch(report, "batch lane differs", m, f, got, expected[l]);
+					return false;
+				}
+			}
+		}
+		steps += batch->getStats().steps;
+		laneCycles += batch->getStats().laneCycles;
+	}
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "PASS: %d machines x %d lanes x %d frames\nlanes together: %.1f%%\n",
+		(int)machines.size(), lanes, frames, steps > 0 ? 100.0 * laneCycles / (steps * lanes) : 0);
+	report = buf;
+	return true;
+}
+
+bool runFusionTest(const std::vector<Chip8>& machines, int frames, std::string& report) {
+	Random random = { 0x5eed0034 };
+
+	for (int m = 0; m < (int)machines.size(); m++) {
+		Chip8 got = machines[m];
+		Chip8 expected = machines[m];
+		FusionTable fusion;
+		Chip8 saved = got;
+
+		for (int f = 0; f < frames; f++) {
+			//go back to a save state now and then, like run-ahead and rollback do. The table
+			//keeps what it scanned since, which may no longer be in memory
+			if (f % 64 == 0) saved = got;
+			if (f % 64 == 48) {
+				got = saved;
+				expected = saved;
+			}
+
+			unsigned short keys = randomKeys(random);
+			setKeys(got, keys);
+			setKeys(expected, keys);
+
+			bool drew = got.runFrame(fusion);
+			bool expectedDrew = stepFrame(expected);
+			//opcode is what cycle() last ran, the end of a fused sequence included
+			bool sameOpcode = got.dumpDebug().opcode == expected.dumpDebug().opcode;
+			if (!sameMachine(got, expected) || !sameOpcode || drew != expectedDrew) {
+				reportMismatch(report, "fused runFrame differs", m, f, got, expected);
+				return false;
+			}
+		}
+	}
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "PASS: %d machines x %d frames\n", (int)machines.size(), frames);
+	report = buf;
+	return true;
+}
+
+bool runCompactTest(const std::vector<Chip8>& machines, int frames, std::string& report) {
+	//the explorer runs many states on one runner, so two run here, taking turns
+	const int STATES = 2;
+	Random random = { 0x5eed0039 };
+	std::vector<unsigned char> visited[STATES];
+	std::vector<unsigned char> expectedVisited[STATES];
+	Chip8 got;
+	Chip8 covered;
+	CompactChip8 repacked;
+	int storedPages = 0;
+
+	for (int m = 0; m < (int)machines.size(); m++) {
+		CompactRunner runner(machines[m]);
+		CompactChip8 states[STATES];
+		Chip8 expected[STATES];
+		for (int s = 0; s < STATES; s++) {
+			runner.pack(machines[m], states[s]);
+			expected[s] = machines[m];
+			visited[s].assign(4096, 0);
+			expectedVisited[s].assign(4096, 0);
+		}
+
+		for (int f = 0; f < frames; f++) {
+			for (int s = 0; s < STATES; s++) {
+				unsigned short keys = randomKeys(random);
+				states[s].setKeys(keys);
+				setKeys(expected[s], keys);
+
+				bool drew;
+				if ((f + s) % 2 == 0) {
+					drew = runner.runFrame(states[s]);
+				}
+				else {
+					covered = expected[s];
+					int fresh = 0;
+					int expectedFresh = 0;
+					drew = runner.runFrame(states[s], visited[s].data(), fresh);
+					covered.runFrame(expectedVisited[s].data(), expectedFresh);
+					if (fresh != expectedFresh || visited[s] != expectedVisited[s]) {
+						runner.unpack(states[s], got);
+						reportMismatch(report, "compact coverage differs", m, f, got, covered);
+						return false;
+					}
+				}
+				bool expectedDrew = stepFrame(expected[s]);
+
+				runner.unpack(states[s], got);
+				if (!sameMachine(got, expected[s]) || drew != expectedDrew) {
+					reportMismatch(report, "compact machine differs", m, f, got, expected[s]);
+					return false;
+				}
+				//the hash the explorer dedupes on has to match packing the machine afresh
+				runner.pack(got, repacked);
+				if (states[s].hash() != repacked.hash()) {
+					reportMismatch(report, "compact hash differs", m, f, got, expected[s]);
+					return false;
+				}
+			}
+		}
+		for (int s = 0; s < STATES; s++) {
+			storedPages += states[s].getPageCount();
+		}
+	}
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "PASS: %d machines x %d states x %d frames\npages stored at the end: %d\n",
+		(int)machines.size(), STATES, frames, storedPages);
+	report = buf;
+	return true;
+}
+
+namespace {
+	//Key 5 then key 7 reaches 0x220 in two frames and ends them at 0x222.
+	//Key A, B then C gets there too but takes three. Every other input
+	//loops in place
+	const unsigned short EXPLORER_ROM[] = {
+		0x6005, //200: V0 = 5
+		0x610a, //202: V1 = A
+		0xe09e, //204: skip if key V0
+		0x1210, //206: go try the longer way
+		0x6007, //208: V0 = 7
+		0xe09e, //20A: skip if key V0
+		0x120a, //20C: wait for it
+		0x1220, //20E
+		0xe19e, //210: skip if key V1
+		0x1204, //212: back to the start of the wait
+		0x7101, //214: V1 = B
+		0xe19e, //216: skip if key V1
+		0x1216, //218: wait for it
+		0x7101, //21A: V1 = C
+		0xe19e, //21C: skip if key V1
+		0x121c, //21E: wait for it
+		0x6301, //220: V3 = 1
+		0x1222 //222: done
+	};
+	const unsigned short EXPLORER_TARGET = 0x220;
+	const unsigned short EXPLORER_DONE = 0x222;
+
+	void formatInputs(char* out, int outLen, const std::vector<unsigned short>& inputs) {
+		int used = snprintf(out, outLen, "%d frames:", (int)inputs.size());
+		for (int i = 0; i < (int)inputs.size() && used > 0 && used < outLen; i++) {
+			used += snprintf(out + used, outLen - used, " %04x", inputs[i]);
+		}
+	}
+
+	bool failExplorer(std::string& report, const char* what, const std::vector<unsigned short>& inputs) {
+		char list[128];
+		formatInputs(list, sizeof(list), inputs);
+		report = std::string("FAIL: ") + what + ", got " + list + "\n";
+		return false;
+	}
+}
+
+bool runExplorerTest(int threads, std::string& report) {
+	std::vector<char> rom;
+	for (unsigned short op : EXPLORER_ROM) {
+		rom.push_back((char)(op >> 8));
+		rom.push_back((char)(op & 0xff));
+	}
+	Chip8 start;
+	start.initialize();
+	start.loadProgram(rom.data(), (int)rom.size());
+
+	const std::vector<unsigned short> shortest = { 1 << 0x5, 1 << 0x7 };
+	std::vector<unsigned short> inputs;
+	Explorer::Settings settings;
+	settings.order = Explorer::Order::BreadthFirst;
+	settings.maxFrames = 10;
+	settings.threads = threads;
+
+	Explorer breadth(start);
+	//targets see the machine between frames, so the pc it ends up looping at
+	int pc = breadth.addTarget("pc", [](const Chip8& state) { return state.getPc() == EXPLORER_DONE; });
+	int v3 = breadth.addTarget("V3", [](const Chip8& state) { return state.dumpDebug().V[3] == 1; });
+	int never = breadth.addTarget("never", [](const Chip8& state) { return state.dumpDebug().V[3] == 2; });
+	Explorer::Report found = breadth.run(settings);
+	if (!found.complete) return failExplorer(report, "breadth first search didn't finish", inputs);
+	if (!breadth.getTargetInputs(pc, inputs) || inputs != shortest) {
+		return failExplorer(report, "pc target isn't the shortest input", inputs);
+	}
+	if (!breadth.getTargetInputs(v3, inputs) || inputs != shortest) {
+		return failExplorer(report, "register target isn't the shortest input", inputs);
+	}
+	if (!breadth.getInputsTo(EXPLORER_TARGET, inputs) || inputs != shortest) {
+		return failExplorer(report, "input to the target address isn't the shortest", inputs);
+	}
+	if (!breadth.getInputsTo(0x21a, inputs) || inputs != std::vector<unsigned short>{ 1 << 0xa, 1 << 0xb }) {
+		return failExplorer(report, "input to 21A isn't key A then B", inputs);
+	}
+	if (breadth.getTargetInputs(never, inputs) || breadth.getInputsTo(0x224, inputs)) {
+		return failExplorer(report, "found something the ROM never does", inputs);
+	}
+
+	//best first finds some input, not the shortest, but it has to work when replayed
+	settings.order = Explorer::Order::BestFirst;
+	Explorer best(start);
+	best.addTarget("pc", [](const Chip8& state) { return state.getPc() == EXPLORER_DONE; });
+	best.run(settings);
+	if (!best.getTargetInputs(0, inputs)) return failExplorer(report, "best first didn't find the target", inputs);
+	Chip8 replay = start;
+	for (unsigned short keys : inputs) {
+		setKeys(replay, keys);
+		stepFrame(replay);
+	}
+	if (replay.dumpDebug().V[3] != 1) return failExplorer(report, "best first input doesn't reach the target", inputs);
+
+	//one frame is too short to get there
+	settings.order = Explorer::Order::BreadthFirst;
+	settings.maxFrames = 1;
+	Explorer shallow(start);
+	shallow.addTarget("pc", [](const Chip8& state) { return state.getPc() == EXPLORER_DONE; });
+	Explorer::Report cut = shallow.run(settings);
+	if (cut.complete || shallow.getTargetInputs(0, inputs) || shallow.getInputsTo(EXPLORER_TARGET, inputs)) {
+		return failExplorer(report, "a one frame search reached the target", inputs);
+	}
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "PASS: %d threads, %llu states, %llu frames\n",
+		threads, found.states, found.frames);
+	report = buf;
+	return true;
+}
+
+namespace {
+	//Region the shared frame check uses, apart from the one Options > Share Frames publishes to
+	const char* SHARED_FRAME_TEST_NAME = "chip8-frames-check";
+
+	/// <summary>
+	/// Fill every field from frame.frame, so a reader can tell a frame
+	/// that was copied while being overwritten
+	/// </summary>
+	void fillSharedFrame(SharedFrame& frame, uint64_t n) {
+		frame.frame = n;
+		frame.pc = (uint16_t)(n * 7 & 0xfff);
+		frame.opcode = (uint16_t)(n * 13);
+		frame.i = (uint16_t)(n * 5 & 0xfff);
+		frame.sp = (uint16_t)(n & 15);
+		for (int k = 0; k < 16; k++) {
+			frame.stack[k] = (uint16_t)(n + k);
+			frame.v[k] = (uint8_t)(n + k);
+		}
+		frame.delay_timer = (uint8_t)(n * 3);
+		frame.sound_timer = (uint8_t)(n * 11);
+		for (int b = 0; b < 32 * 8; b++) {
+			frame.screen[b] = (uint8_t)(n + b);
+		}
+	}
+
+	bool wholeSharedFrame(const SharedFrame& frame) {
+		SharedFrame expected = {};
+		fillSharedFrame(expected, frame.frame);
+		expected.seq = frame.seq;
+		//up to the end of screen, the padding after it isn't copied the same way every time
+		return memcmp(&expected, &frame, offsetof(SharedFrame, screen) + sizeof(frame.screen)) == 0;
+	}
+}
+
+bool runSharedFrameTest(int frames, std::string& report) {
+	SharedFrameWriter writer;
+	SharedFrameReader reader;
+	if (!writer.create(SHARED_FRAME_TEST_NAME) || !reader.open(SHARED_FRAME_TEST_NAME)) {
+		report = "FAIL: couldn't create the shared memory region\n";
+		return false;
+	}
+	if (reader.isClosed()) {
+		report = "FAIL: a new region reads as closed\n";
+		return false;
+	}
+	//0 unless a reader elsewhere kept an old region of this name for us to take over
+	uint64_t base = reader.latest();
+
+	//publish from a thread while this one follows every frame, like examples/FrameReader.cpp
+	SharedFrame frame;
+	std::thread publisher([&writer, frames]() {
+		for (int f = 1; f <= frames; f++) {
+			SharedFrame out = {};
+			fillSharedFrame(out, f);
+			writer.publish(out);
+		}
+	});
+	uint64_t next = base + 1;
+	unsigned long long received = 0;
+	unsigned long long skipped = 0;
+	bool torn = false;
+	bool wrongSeq = false;
+	for (;;) {
+		uint64_t latest = reader.latest();
+		if (latest >= next + SHARED_FRAME_SLOTS) {
+			skipped += latest - SHARED_FRAME_SLOTS + 1 - next;
+			next = latest - SHARED_FRAME_SLOTS + 1;
+		}
+		for (; next <= latest; next++) {
+			if (!reader.read(next, frame)) {
+				skipped++;
+				continue;
+			}
+			received++;
+			if (!wholeSharedFrame(frame)) torn = true;
+			if (frame.seq != next || frame.frame != frame.seq - base) wrongSeq = true;
+		}
+		if (latest == base + frames) break;
+		//caught up. Keep reading the oldest frame, the next the writer
+		//overwrites, so reads overlap writes even on one core
+		for (int r = 0; r < 64 && latest > base + SHARED_FRAME_SLOTS; r++) {
+			if (reader.read(latest - SHARED_FRAME_SLOTS + 1, frame) && !wholeSharedFrame(frame)) torn = true;
+		}
+	}
+	publisher.join();
+	if (torn || wrongSeq) {
+		report = torn ? "FAIL: read a frame that was being overwritten\n" : "FAIL: read returned the wrong frame\n";
+		return false;
+	}
+	//the ring keeps the last SHARED_FRAME_SLOTS and nothing older
+	uint64_t latest = reader.latest();
+	bool kept = true;
+	for (uint64_t seq = latest - SHARED_FRAME_SLOTS + 1; seq <= latest; seq++) {
+		if (!reader.read(seq, frame) || !wholeSharedFrame(frame)) kept = false;
+	}
+	if (!kept || reader.read(latest - SHARED_FRAME_SLOTS, frame) || reader.read(latest + 1, frame)) {
+		report = "FAIL: the ring doesn't hold exactly the newest frames\n";
+		return false;
+	}
+
+	//a new run starting while this one never closed, the way it looks after a crash.
+	//Windows hands it the same mapping to take over, POSIX a new region
+	SharedFrameWriter nextRun;
+	if (!nextRun.create(SHARED_FRAME_TEST_NAME)) {
+		report = "FAIL: a new run couldn't replace the region\n";
+		return false;
+	}
+	if (!reader.isClosed()) {
+		report = "FAIL: a reader of the old run didn't see it closed\n";
+		return false;
+	}
+	SharedFrameReader again;
+	SharedFrame out = {};
+	fillSharedFrame(out, 1);
+	nextRun.publish(out);
+	if (!again.open(SHARED_FRAME_TEST_NAME) || again.isClosed() || !again.readLatest(frame)
+		|| !wholeSharedFrame(frame) || frame.frame != 1) {
+		report = "FAIL: a reader couldn't follow the new run\n";
+		return false;
+	}
+	//the old run's sequence numbers are never handed out again while its readers could mistake them
+	if (latest + 1 != frame.seq && frame.seq != 1) {
+		report = "FAIL: the new run's sequence numbers don't follow on or restart\n";
+		return false;
+	}
+
+	nextRun.close();
+	if (!again.isClosed()) {
+		report = "FAIL: a reader didn't see the writer close\n";
+		return false;
+	}
+	again.close();
+	reader.close();
+	writer.close();
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "PASS: %d frames published, %llu read whole, %llu overwritten first\n",
+		frames, received, skipped);
+	report = buf;
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "Chip8.h"
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Equivalence checks for the alternate ways of running the core
+/// ===================================================================================
+/// The batch interpreter, runFrame()'s fused sequences and CompactRunner
+/// have to behave exactly like the plain interpreter run one instruction
+/// at a time. Each check here runs the same machines
+/// with the same random input both ways and compares the machines after
+/// every frame. Any core change has to keep them passing.
+///
+/// makeTestMachines() builds machines with random ROMs made of every
+/// opcode. Those ROMs also include the edge cases real ROMs avoid:
+/// stack overflow, I past the end of memory and FX0A waits.
+///
+/// runExplorerTest and runSharedFrameTest are the odd ones out. The first
+/// checks the search built on top of CompactRunner against input worked
+/// out by hand, the second the shared memory ring other processes read.
+/// ===================================================================================
+/// </summary>
+
+/// <summary>
+/// Fresh machines, each with a random ROM and its own random seed
+/// </summary>
+std::vector<Chip8> makeTestMachines(int count, unsigned int seed);
+
+/// <summary>
+/// Run every machine through Chip8Batch with a different keypad per lane
+/// and compare each lane to a Chip8 stepped one instruction at a time.
+/// Machines with Vip timing are checked as Flat, the only timing lanes run
+/// </summary>
+/// <returns>true if every lane matched on every frame</returns>
+bool runBatchTest(const std::vector<Chip8>& machines, int frames, std::string& report);
+
+/// <summary>
+/// Run every machine with runFrame(FusionTable&), which fuses common
+/// sequences, and compare it to a copy stepped one instruction at a time.
+/// Both go back to a save state every so often while the table doesn't
+/// </summary>
+/// <returns>true if they matched on every frame</returns>
+bool runFusionTest(const std::vector<Chip8>& machines, int frames, std::string& report);
+
+/// <summary>
+/// Run two CompactChip8 of every machine on one runner, with different
+/// keys, and compare each to a copy stepped one instruction at a time.
+/// Every other frame records coverage,
+/// which has to match what Chip8::runFrame(visited, newlyVisited) records
+/// </summary>
+/// <returns>true if they matched on every frame</returns>
+bool runCompactTest(const std::vector<Chip8>& machines, int frames, std::string& report);
+
+/// <summary>
+/// Search a small key-gated ROM with Explorer on several threads. Breadth
+/// first has to find the shortest input to its targets and addresses,
+/// best first an input that works when replayed
+/// </summary>
+/// <returns>true if every search found what it should</returns>
+bool runExplorerTest(int threads, std::string& report);
+
+/// <summary>
+/// Publish frames through SharedFrameWriter from one thread while a
+/// SharedFrameReader follows them from another. Every frame read has to be
+/// whole and the one asked for. Then a second writer starts on the same
+/// name without the first closing, like a run after a crash, and the old
+/// reader has to see the region closed
+/// </summary>
+/// <returns>true if the readers saw what they should</returns>
+bool runSharedFrameTest(int frames, std::string& report);
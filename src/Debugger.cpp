@@ -0,0 +1,372 @@
+#include "Debugger.h"
+#include "Chip8.h"
+#include <stdio.h>
+
+namespace {
+	/// <summary>
+	/// True if two address ranges share an address. Either may run past
+	/// 0xFFF and wrap to 0, the way accesses through I do
+	/// </summary>
+	bool overlaps(int start, int len, int otherStart, int otherLen) {
+		if (start + len > 4096) {
+			return overlaps(start, 4096 - start, otherStart, otherLen) || overlaps(0, start + len - 4096, otherStart, otherLen);
+		}
+		if (otherStart + otherLen > 4096) {
+			return overlaps(start, len, otherStart, 4096 - otherStart) || overlaps(start, len, 0, otherStart + otherLen - 4096);
+		}
+		return start < otherStart + otherLen && otherStart < start + len;
+	}
+}
+
+Debugger::Debugger() {
+	clearBreakpoints();
+	paused = false;
+	reason = BreakReason::None;
+	stepMode = StepMode::None;
+	stepPc = 0;
+	stepSp = 0;
+	skipChecks = false;
+}
+
+void Debugger::toggleBreakpoint(unsigned short address) {
+	address &= 0x0fff;
+	breakpoints[address] = !breakpoints[address];
+}
+
+bool Debugger::hasBreakpoint(unsigned short address) const {
+	return breakpoints[address & 0x0fff];
+}
+
+void Debugger::clearBreakpoints() {
+	for (int i = 0; i < 4096; i++) {
+		breakpoints[i] = false;
+	}
+}
+
+void Debugger::addWatchpoint(unsigned short address, unsigned short length, WatchType type) {
+	if (length == 0) length = 1;
+	watchpoints.push_back({ (unsigned short)(address & 0x0fff), length, type });
+}
+
+void Debugger::removeWatchpoint(int index) {
+	if (index < 0 || index >= (int)watchpoints.size()) return;
+	watchpoints.erase(watchpoints.begin() + index);
+}
+
+void Debugger::addCondition(Register reg, Compare cmp, unsigned short value) {
+	conditions.push_back({ reg, cmp, value });
+}
+
+void Debugger::removeCondition(int index) {
+	if (index < 0 || index >= (int)conditions.size()) return;
+	conditions.erase(conditions.begin() + index);
+}
+
+void Debugger::pause() {
+	stop(BreakReason::Paused);
+}
+
+void Debugger::resume() {
+	paused = false;
+	reason = BreakReason::None;
+	stepMode = StepMode::None;
+	skipChecks = true;
+}
+
+/// <summary>
+/// Run exactly one instruction
+/// </summary>
+void Debugger::stepInto() {
+	resume();
+	stepMode = StepMode::Into;
+}
+
+/// <summary>
+/// Run one instruction. If it is a 2NNN call, run until the
+/// subroutine returns to the instruction after it
+/// </summary>
+void Debugger::stepOver(const Chip8& core) {
+	unsigned short op = readOpcode(core, core.pc);
+	resume();
+	if ((op & 0xf000) == 0x2000) {
+		stepMode = StepMode::Over;
+		stepPc = core.pc + 2;
+		stepSp = core.sp;
+	}
+	else {
+		stepMode = StepMode::Into;
+	}
+}
+
+/// <summary>
+/// Run until the current subroutine returns
+/// </summary>
+void Debugger::stepOut(const Chip8& core) {
+	if (core.sp == 0) {
+		//nothing to return from
+		stepInto();
+		return;
+	}
+	resume();
+	stepMode = StepMode::Out;
+	stepSp = core.sp;
+}
+
+void Debugger::stop(BreakReason why) {
+	paused = true;
+	reason = why;
+	stepMode = StepMode::None;
+}
+
+bool Debugger::beforeExecute(const Chip8& core) {
+	if (paused) return false;
+
+	if (skipChecks) {
+		skipChecks = false;
+		return true;
+	}
+
+	switch (stepMode) {
+	case StepMode::Into:
+		stop(BreakReason::Step);
+		return false;
+	case StepMode::Over:
+		if (core.pc == stepPc && core.sp == stepSp) {
+			stop(BreakReason::Step);
+			return false;
+		}
+		break;
+	case StepMode::Out:
+		if (core.sp < stepSp) {
+			stop(BreakReason::Step);
+			return false;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (breakpoints[core.pc & 0x0fff]) {
+		stop(BreakReason::Breakpoint);
+		return false;
+	}
+
+	if (!watchpoints.empty() && hitWatchpoint(core, readOpcode(core, core.pc))) {
+		stop(BreakReason::Watchpoint);
+		return false;
+	}
+
+	if (!conditions.empty() && hitCondition(core)) {
+		stop(BreakReason::Condition);
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Checks the memory range the next opcode is going to touch
+/// against our watchpoints
+/// </summary>
+bool Debugger::hitWatchpoint(const Chip8& core, unsigned short opcode) const {
+	unsigned short start = core.I & 0x0fff;
+	unsigned short len = 0;
+	WatchType access = WatchType::Read;
+
+	unsigned char x = (opcode & 0x0f00) >> 8;
+	switch (opcode & 0xf000) {
+	case 0xd000: //DXYN reads N bytes of sprite data
+		len = opcode & 0x000f;
+		break;
+	case 0xf000:
+		switch (opcode & 0x00ff) {
+		case 0x33: //FX33 writes 3 BCD digits
+			len = 3;
+			access = WatchType::Write;
+			break;
+		case 0x55: //FX55 writes V0 to Vx
+			len = x + 1;
+			access = WatchType::Write;
+			break;
+		case 0x65: //FX65 reads V0 to Vx
+			len = x + 1;
+			break;
+		}
+		break;
+	}
+	if (len == 0) return false;
+
+	for (const Watchpoint& w : watchpoints) {
+		if (((int)w.type & (int)access) == 0) continue;
+		if (overlaps(start, len, w.address, w.length)) return true;
+	}
+	return false;
+}
+
+bool Debugger::hitCondition(const Chip8& core) const {
+	for (const Condition& c : conditions) {
+		unsigned short value = readRegister(core, c.reg);
+
+		bool hit = false;
+		switch (c.cmp) {
+		case Compare::Equal:
+			hit = value == c.value;
+			break;
+		case Compare::NotEqual:
+			hit = value != c.value;
+			break;
+		case Compare::Less:
+			hit = value < c.value;
+			break;
+		case Compare::Greater:
+			hit = value > c.value;
+			break;
+		}
+		if (hit) return true;
+	}
+	return false;
+}
+
+unsigned short Debugger::readOpcode(const Chip8& core, unsigned short address) {
+	address &= 0x0fff;
+	return core.memory[address] << 8 | core.memory[(address + 1) & 0x0fff];
+}
+
+unsigned char Debugger::readByte(const Chip8& core, unsigned short address) {
+	return core.memory[address & 0x0fff];
+}
+
+unsigned short Debugger::readRegister(const Chip8& core, Register reg) {
+	switch (reg) {
+	case Register::I:
+		return core.I;
+	case Register::DT:
+		return core.delay_timer;
+	case Register::ST:
+		return core.sound_timer;
+	case Register::SP:
+		return core.sp;
+	default:
+		return core.V[(int)reg];
+	}
+}
+
+const char* Debugger::registerName(Register reg) {
+	static const char* names[] = {
+		"V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7",
+		"V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF",
+		"I", "DT", "ST", "SP"
+	};
+	return names[(int)reg];
+}
+
+/// <summary>
+/// Write a human readable form of an opcode to out
+/// </summary>
+/// <param name="opcode">opcode to disassemble</param>
+/// <param name="out">buffer to fill</param>
+/// <param name="outLen">size of out in bytes</param>
+void Debugger::disassemble(unsigned short opcode, char* out, int outLen) {
+	unsigned int x = (opcode & 0x0f00) >> 8;
+	unsigned int y = (opcode & 0x00f0) >> 4;
+	unsigned int n = opcode & 0x000f;
+	unsigned int nn = opcode & 0x00ff;
+	unsigned int nnn = opcode & 0x0fff;
+
+	switch ((opcode & 0xf000) >> 12) {
+	case 0x0:
+		if (opcode == 0x00e0) snprintf(out, outLen, "CLS");
+		else if (opcode == 0x00ee) snprintf(out, outLen, "RET");
+		else snprintf(out, outLen, "SYS  %03X", nnn);
+		return;
+	case 0x1:
+		snprintf(out, outLen, "JP   %03X", nnn);
+		return;
+	case 0x2:
+		snprintf(out, outLen, "CALL %03X", nnn);
+		return;
+	case 0x3:
+		snprintf(out, outLen, "SE   V%X, %02X", x, nn);
+		return;
+	case 0x4:
+		snprintf(out, outLen, "SNE  V%X, %02X", x, nn);
+		return;
+	case 0x5:
+		snprintf(out, outLen, "SE   V%X, V%X", x, y);
+		return;
+	case 0x6:
+		snprintf(out, outLen, "LD   V%X, %02X", x, nn);
+		return;
+	case 0x7:
+		snprintf(out, outLen, "ADD  V%X, %02X", x, nn);
+		return;
+	case 0x8: {
+		static const char* ops[16] = {
+			"LD  ", "OR  ", "AND ", "XOR ", "ADD ", "SUB ", "SHR ", "SUBN",
+			NULL, NULL, NULL, NULL, NULL, NULL, "SHL ", NULL
+		};
+		if (ops[n] != NULL) {
+			snprintf(out, outLen, "%s V%X, V%X", ops[n], x, y);
+			return;
+		}
+		break;
+	}
+	case 0x9:
+		snprintf(out, outLen, "SNE  V%X, V%X", x, y);
+		return;
+	case 0xa:
+		snprintf(out, outLen, "LD   I, %03X", nnn);
+		return;
+	case 0xb:
+		snprintf(out, outLen, "JP   V0, %03X", nnn);
+		return;
+	case 0xc:
+		snprintf(out, outLen, "RND  V%X, %02X", x, nn);
+		return;
+	case 0xd:
+		snprintf(out, outLen, "DRW  V%X, V%X, %X", x, y, n);
+		return;
+	case 0xe:
+		if (nn == 0x9e) {
+			snprintf(out, outLen, "SKP  V%X", x);
+			return;
+		}
+		if (nn == 0xa1) {
+			snprintf(out, outLen, "SKNP V%X", x);
+			return;
+		}
+		break;
+	case 0xf:
+		switch (nn) {
+		case 0x07:
+			snprintf(out, outLen, "LD   V%X, DT", x);
+			return;
+		case 0x0a:
+			snprintf(out, outLen, "LD   V%X, K", x);
+			return;
+		case 0x15:
+			snprintf(out, outLen, "LD   DT, V%X", x);
+			return;
+		case 0x18:
+			snprintf(out, outLen, "LD   ST, V%X", x);
+			return;
+		case 0x1e:
+			snprintf(out, outLen, "ADD  I, V%X", x);
+			return;
+		case 0x29:
+			snprintf(out, outLen, "LD   F, V%X", x);
+			return;
+		case 0x33:
+			snprintf(out, outLen, "LD   B, V%X", x);
+			return;
+		case 0x55:
+			snprintf(out, outLen, "LD   [I], V%X", x);
+			return;
+		case 0x65:
+			snprintf(out, outLen, "LD   V%X, [I]", x);
+			return;
+		}
+		break;
+	}
+	snprintf(out, outLen, "DW   %04X", opcode);
+}
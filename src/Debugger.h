@@ -0,0 +1,126 @@
+#pragma once
+#include <vector>
+
+class Chip8;
+
+/// <summary>
+/// Debugger for our CHIP-8 machine
+/// ===================================================================================
+/// Supports PC breakpoints, memory read/write watchpoints, register conditions
+/// and step into/over/out.
+///
+/// The checks are only made by Chip8::doCycle(Debugger&), which is its own
+/// instantiation of the interpreter loop. The plain Chip8::doCycle() never
+/// calls into here.
+/// ===================================================================================
+/// </summary>
+class Debugger
+{
+public:
+	enum class WatchType {
+		Read = 1,
+		Write = 2,
+		ReadWrite = 3
+	};
+
+	/// <summary>
+	/// Registers a condition can be checked against.
+	/// V0-VF map to 0x0-0xF so a register index can be cast directly.
+	/// </summary>
+	enum class Register {
+		V0, V1, V2, V3, V4, V5, V6, V7, V8, V9, VA, VB, VC, VD, VE, VF,
+		I,
+		DT,
+		ST,
+		SP
+	};
+
+	enum class Compare {
+		Equal,
+		NotEqual,
+		Less,
+		Greater
+	};
+
+	enum class BreakReason {
+		None,
+		Paused,
+		Breakpoint,
+		Watchpoint,
+		Condition,
+		Step
+	};
+
+	struct Watchpoint {
+		unsigned short address;
+		unsigned short length;
+		WatchType type;
+	};
+
+	struct Condition {
+		Register reg;
+		Compare cmp;
+		unsigned short value;
+	};
+
+	Debugger();
+
+	//breakpoints
+	void toggleBreakpoint(unsigned short address);
+	bool hasBreakpoint(unsigned short address) const;
+	void clearBreakpoints();
+	//watchpoints
+	void addWatchpoint(unsigned short address, unsigned short length, WatchType type);
+	void removeWatchpoint(int index);
+	const std::vector<Watchpoint>& getWatchpoints() const { return watchpoints; }
+	//conditions
+	void addCondition(Register reg, Compare cmp, unsigned short value);
+	void removeCondition(int index);
+	const std::vector<Condition>& getConditions() const { return conditions; }
+
+	//execution control
+	void pause();
+	void resume();
+	void stepInto();
+	void stepOver(const Chip8& core);
+	void stepOut(const Chip8& core);
+
+	bool isPaused() const { return paused; }
+	BreakReason getBreakReason() const { return reason; }
+
+	/// <summary>
+	/// Called by the debug instantiation of Chip8::doCycle before every instruction.
+	/// </summary>
+	/// <returns>false if the machine should stop before executing the instruction at pc</returns>
+	bool beforeExecute(const Chip8& core);
+
+	static unsigned short readOpcode(const Chip8& core, unsigned short address);
+	static unsigned char readByte(const Chip8& core, unsigned short address);
+	static unsigned short readRegister(const Chip8& core, Register reg);
+	static void disassemble(unsigned short opcode, char* out, int outLen);
+	static const char* registerName(Register reg);
+
+private:
+	enum class StepMode {
+		None,
+		Into,
+		Over,
+		Out
+	};
+
+	bool breakpoints[4096];
+	std::vector<Watchpoint> watchpoints;
+	std::vector<Condition> conditions;
+
+	bool paused;
+	BreakReason reason;
+
+	StepMode stepMode;
+	unsigned short stepPc; //pc to stop at when stepping over a subroutine call
+	unsigned short stepSp; //stack depth the step started at
+	bool skipChecks; //let the first instruction after a resume run, so we can leave a breakpoint
+
+	bool hitWatchpoint(const Chip8& core, unsigned short opcode) const;
+	bool hitCondition(const Chip8& core) const;
+	void stop(BreakReason why);
+};
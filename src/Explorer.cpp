@@ -0,0 +1,326 @@
+#include "Explorer.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+Explorer::Explorer(const Chip8& start) : start(start), targetsLeft(0), seenMask(0), busy(0), level(0), truncated(false),
+	running(false), stopping(false), states(0), frames(0), depth(0), covered(0) {
+	for (int i = 0; i < 4096; i++) {
+		coveredAt[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+int Explorer::addTarget(const std::string& name, std::function<bool(const Chip8&)> test) {
+	targets.emplace_back(new Target());
+	Target& t = *targets.back();
+	t.name = name;
+	t.test = test;
+	t.found.store(false, std::memory_order_relaxed);
+	return (int)targets.size() - 1;
+}
+
+void Explorer::stop() {
+	stopping.store(true, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> guard(lock);
+	wakeup.notify_all();
+}
+
+/// <summary>
+/// Add a hash to the seen set
+/// </summary>
+/// <returns>true if it wasn't there before</returns>
+bool Explorer::insert(unsigned long long hash) {
+	if (hash == 0) hash = 1;
+	unsigned long long at = hash & seenMask;
+	for (;;) {
+		unsigned long long slot = seen[at].load(std::memory_order_relaxed);
+		if (slot == hash) return false;
+		if (slot == 0) {
+			if (seen[at].compare_exchange_strong(slot, hash, std::memory_order_relaxed)) return true;
+			//someone else took the slot, maybe with this same hash
+			if (slot == hash) return false;
+		}
+		at = (at + 1) & seenMask;
+	}
+}
+
+/// <summary>
+/// True if a should be run before b
+/// </summary>
+bool Explorer::before(const Open& a, const Open& b) const {
+	if (settings.order == Order::BestFirst && a.score != b.score) return a.score > b.score;
+	return a.depth < b.depth;
+}
+
+/// <summary>
+/// Wait for a state this thread may run
+/// </summary>
+/// <returns>false once the search is over</returns>
+bool Explorer::take(Open& out) {
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;) {
+		bool full = states.load(std::memory_order_relaxed) >= (unsigned long long)settings.maxStates;
+		if (stopping.load(std::memory_order_relaxed) || full) return false;
+
+		if (!open.empty()) {
+			//breadth first only moves a level down once every state of this one is done,
+			//so a deeper state can never claim a hash first
+			bool ready = settings.order != Order::BreadthFirst || open.front().depth == level || busy == 0;
+			if (ready) {
+				std::pop_heap(open.begin(), open.end(), [this](const Open& a, const Open& b) { return before(b, a); });
+				out = std::move(open.back());
+				open.pop_back();
+				if (out.depth > level) level = out.depth;
+				busy++;
+				return true;
+			}
+		}
+		else if (busy == 0) {
+			//nothing left and nobody running anything that could add more
+			wakeup.notify_all();
+			return false;
+		}
+		wakeup.wait(guard);
+	}
+}
+
+/// <summary>
+/// Run a state for one frame with every input
+/// </summary>
+void Explorer::expand(CompactRunner& runner, const Open& from, std::vector<Open>& children,
+	unsigned char* visited, unsigned char* reported, Chip8& full) {
+	unsigned long long ran = 0;
+
+	for (unsigned short keys : settings.inputs) {
+		Open child;
+		child.state = from.state;
+		child.link.parent = from.node;
+		child.link.keys = keys;
+		child.node = -1;
+		child.depth = from.depth + 1;
+		child.score = 0;
+
+		int fresh = 0;
+		child.state.setKeys(keys);
+		runner.runFrame(child.state, visited, fresh);
+		ran++;
+
+		//only look through visited when this thread ran somewhere it hadn't before
+		if (fresh > 0) {
+			for (int at = 0; at < 4096; at++) {
+				if (visited[at] == reported[at]) continue;
+				reported[at] = 1;
+				unsigned char was = 0;
+				if (coveredAt[at].compare_exchange_strong(was, 1, std::memory_order_relaxed)) {
+					coverage[at] = child.link;
+					covered.fetch_add(1, std::memory_order_relaxed);
+					child.score++;
+				}
+			}
+		}
+
+		//the next frame sets its own keys, so states differing only in them are the same
+		child.state.setKeys(0);
+		if (!insert(child.state.hash())) continue;
+		states.fetch_add(1, std::memory_order_relaxed);
+
+		if (targetsLeft.load(std::memory_order_relaxed) > 0) {
+			runner.unpack(child.state, full);
+			for (const std::unique_ptr<Target>& t : targets) {
+				if (t->found.load(std::memory_order_relaxed) || !t->test(full)) continue;
+				bool was = false;
+				if (t->found.compare_exchange_strong(was, true)) {
+					t->link = child.link;
+					targetsLeft.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+		}
+		children.push_back(std::move(child));
+	}
+	frames.fetch_add(ran, std::memory_order_relaxed);
+}
+
+void Explorer::work() {
+	CompactRunner runner(start);
+	std::vector<unsigned char> visited(4096, 0);
+	std::vector<unsigned char> reported(4096, 0);
+	std::vector<Open> children;
+	Chip8 full;
+
+	Open from;
+	while (take(from)) {
+		children.clear();
+		expand(runner, from, children, visited.data(), reported.data(), full);
+
+		std::lock_guard<std::mutex> guard(lock);
+		for (Open& child : children) {
+			child.node = (int)nodes.size();
+			nodes.push_back(child.link);
+			if (child.depth >= settings.maxFrames) {
+				truncated = true;
+				continue;
+			}
+			open.push_back(std::move(child));
+			std::push_heap(open.begin(), open.end(), [this](const Open& a, const Open& b) { return before(b, a); });
+		}
+		if (from.depth + 1 > depth.load(std::memory_order_relaxed)) depth.store(from.depth + 1, std::memory_order_relaxed);
+		busy--;
+		wakeup.notify_all();
+	}
+}
+
+Explorer::Report Explorer::run(const Settings& settings) {
+	std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+	this->settings = settings;
+	if (this->settings.inputs.empty()) {
+		this->settings.inputs.push_back(0);
+		for (int k = 0; k < 16; k++) {
+			this->settings.inputs.push_back((unsigned short)(1 << k));
+		}
+	}
+	//the start counts as a state, so there is always at least one
+	if (this->settings.maxStates < 1) this->settings.maxStates = 1;
+	if (this->settings.maxStates > MAX_STATES) this->settings.maxStates = MAX_STATES;
+	if (this->settings.maxFrames < 0) this->settings.maxFrames = 0;
+
+	int count = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+	if (count < 1) count = 1;
+	if (count > MAX_THREADS) count = MAX_THREADS;
+
+	//once maxStates is hit every thread can still be expanding a state, adding a
+	//child per input. Keeping room for those keeps the table at most half full,
+	//insert() never finds it full. With both clamped this can't overflow
+	unsigned long long most = (unsigned long long)this->settings.maxStates + (unsigned long long)count * this->settings.inputs.size();
+	unsigned long long size = 1024;
+	while (size < most * 2 + 65536) size *= 2;
+	seen.reset(new std::atomic<unsigned long long>[size]);
+	seenMask = size - 1;
+	for (unsigned long long i = 0; i < size; i++) {
+		seen[i].store(0, std::memory_order_relaxed);
+	}
+
+	for (int i = 0; i < 4096; i++) {
+		coveredAt[i].store(0, std::memory_order_relaxed);
+	}
+	int left = 0;
+	for (const std::unique_ptr<Target>& t : targets) {
+		bool met = t->test(start);
+		t->found.store(met, std::memory_order_relaxed);
+		t->link.parent = -1;
+		t->link.keys = 0;
+		if (!met) left++;
+	}
+	targetsLeft.store(left, std::memory_order_relaxed);
+
+	nodes.clear();
+	open.clear();
+	busy = 0;
+	level = 0;
+	truncated = false;
+	stopping.store(false, std::memory_order_relaxed);
+	frames.store(0, std::memory_order_relaxed);
+	depth.store(0, std::memory_order_relaxed);
+	covered.store(0, std::memory_order_relaxed);
+
+	//the start is node 0
+	Open first;
+	CompactRunner(start).pack(start, first.state);
+	first.state.setKeys(0);
+	first.link.parent = -1;
+	first.link.keys = 0;
+	first.node = 0;
+	first.depth = 0;
+	first.score = 0;
+	insert(first.state.hash());
+	nodes.push_back(first.link);
+	states.store(1, std::memory_order_relaxed);
+	if (this->settings.maxFrames > 0) open.push_back(std::move(first));
+	else truncated = true;
+
+	running.store(true, std::memory_order_relaxed);
+	std::vector<std::thread> threads;
+	for (int i = 1; i < count; i++) {
+		threads.emplace_back(&Explorer::work, this);
+	}
+	work();
+	for (std::thread& t : threads) {
+		t.join();
+	}
+	running.store(false, std::memory_order_relaxed);
+
+	report.states = states.load(std::memory_order_relaxed);
+	report.frames = frames.load(std::memory_order_relaxed);
+	report.depth = depth.load(std::memory_order_relaxed);
+	report.covered = covered.load(std::memory_order_relaxed);
+	report.complete = open.empty() && !truncated && !stopping.load(std::memory_order_relaxed)
+		&& report.states < (unsigned long long)this->settings.maxStates;
+	report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+	//the tables can be big and are no use after the search
+	seen.reset();
+	open.clear();
+	open.shrink_to_fit();
+	return report;
+}
+
+void Explorer::walk(Link link, std::vector<unsigned short>& inputs) const {
+	inputs.clear();
+	inputs.push_back(link.keys);
+	for (int node = link.parent; node > 0; node = nodes[node].parent) {
+		inputs.push_back(nodes[node].keys);
+	}
+	std::reverse(inputs.begin(), inputs.end());
+}
+
+bool Explorer::getInputsTo(unsigned short address, std::vector<unsigned short>& inputs) const {
+	if (address >= 4096 || coveredAt[address].load(std::memory_order_relaxed) == 0) return false;
+	walk(coverage[address], inputs);
+	return true;
+}
+
+bool Explorer::getTargetInputs(int target, std::vector<unsigned short>& inputs) const {
+	const Target& t = *targets[target];
+	if (!t.found.load(std::memory_order_relaxed)) return false;
+	//met by the start itself
+	if (t.link.parent < 0) {
+		inputs.clear();
+		return true;
+	}
+	walk(t.link, inputs);
+	return true;
+}
+
+namespace {
+	void appendInputs(std::string& out, const std::vector<unsigned short>& inputs) {
+		char text[8];
+		for (unsigned short keys : inputs) {
+			snprintf(text, sizeof(text), " %04x", keys);
+			out += text;
+		}
+	}
+}
+
+std::string Explorer::format() const {
+	char text[128];
+	std::string out;
+	snprintf(text, sizeof(text), "states %llu\nframes %llu\ndepth %d\ncovered %d\ncomplete %s\nseconds %.3f\n",
+		report.states, report.frames, report.depth, report.covered, report.complete ? "yes" : "no", report.seconds);
+	out += text;
+
+	//one keypad per frame, bit n is key n
+	std::vector<unsigned short> inputs;
+	for (int i = 0; i < (int)targets.size(); i++) {
+		out += "target " + targets[i]->name + ":";
+		if (getTargetInputs(i, inputs)) appendInputs(out, inputs);
+		else out += " not found";
+		out += "\n";
+	}
+	for (int address = 0; address < 4096; address++) {
+		if (!getInputsTo((unsigned short)address, inputs)) continue;
+		snprintf(text, sizeof(text), "%03x:", address);
+		out += text;
+		appendInputs(out, inputs);
+		out += "\n";
+	}
+	return out;
+}
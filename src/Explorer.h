@@ -0,0 +1,171 @@
+#pragma once
+#include "Chip8.h"
+#include "CompactChip8.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Searches every input a ROM can be given
+/// ===================================================================================
+/// For automated ROM testing. Starting from a machine, each frame is run
+/// once for every key combination in Settings::inputs, and each result
+/// is a new state to search from. Every state is hashed as it is reached.
+/// A state whose hash was already seen is dropped, so loops and input
+/// that does nothing don't blow up the search.
+///
+/// BreadthFirst finishes every state n frames deep before any n + 1
+/// frames deep. The input found for an address or target is then the
+/// shortest there is. BestFirst runs states that reached code nobody had
+/// run before first. It finds new code sooner, but the input it finds is
+/// only the first one, not the shortest.
+///
+/// States are kept as CompactChip8s against the starting machine and run
+/// on one thread per core, each with its own CompactRunner. The seen set
+/// is a lock free table of hashes. Only states still waiting to be run
+/// keep their machine, the rest are just the key and a link to the state
+/// they came from. Two different states with the same 64 bit hash are
+/// taken as one, which at these counts is very unlikely.
+/// ===================================================================================
+/// </summary>
+class Explorer
+{
+public:
+	enum class Order {
+		BreadthFirst,
+		BestFirst
+	};
+
+	//Largest maxStates and threads run() takes, more are clamped to these
+	static const int MAX_STATES = 1 << 26;
+	static const int MAX_THREADS = 256;
+
+	struct Settings {
+		Order order = Order::BreadthFirst;
+		int maxFrames = 600; //Longest input tried, 0 runs nothing
+		int maxStates = 1 << 20; //Stop after this many distinct states, at least 1
+		int threads = 0; //0 for one per core
+		//Keypads tried every frame, bit n is key n. Empty for no key and each key alone
+		std::vector<unsigned short> inputs;
+	};
+
+	struct Report {
+		unsigned long long states = 0; //Distinct states reached, the start included
+		unsigned long long frames = 0; //Frames run
+		int depth = 0; //Frames deep of the deepest state run
+		int covered = 0; //Addresses an instruction ran at
+		//Nothing left to run: no state was skipped for being maxFrames
+		//deep, maxStates wasn't reached and stop() wasn't called
+		bool complete = false;
+		double seconds = 0;
+	};
+
+	/// <param name="start">machine to search from, usually one straight after loadProgram()</param>
+	Explorer(const Chip8& start);
+
+	/// <summary>
+	/// Something to find the input for. test runs on every new state
+	/// until one passes, from several threads at once
+	/// </summary>
+	/// <returns>index for getTargetInputs</returns>
+	int addTarget(const std::string& name, std::function<bool(const Chip8&)> test);
+
+	/// <summary>
+	/// Search until there is nothing left or a limit is hit.
+	/// Blocks, call from a thread of its own to keep a UI going
+	/// </summary>
+	Report run(const Settings& settings);
+	/// <summary>
+	/// Make run() return soon. Safe from any thread
+	/// </summary>
+	void stop();
+
+	//Progress, safe from any thread while run() works
+	bool isRunning() const { return running.load(std::memory_order_relaxed); }
+	unsigned long long getStates() const { return states.load(std::memory_order_relaxed); }
+	int getDepth() const { return depth.load(std::memory_order_relaxed); }
+	int getCovered() const { return covered.load(std::memory_order_relaxed); }
+
+	//Results. Only while run() isn't working
+
+	const Report& getReport() const { return report; }
+	/// <summary>
+	/// Input that first ran an instruction at an address, one keypad per frame
+	/// </summary>
+	/// <returns>false if nothing ran there</returns>
+	bool getInputsTo(unsigned short address, std::vector<unsigned short>& inputs) const;
+	/// <returns>false if the target wasn't found</returns>
+	bool getTargetInputs(int target, std::vector<unsigned short>& inputs) const;
+
+	/// <summary>
+	/// The report, every target and every covered address with its input, as text
+	/// </summary>
+	std::string format() const;
+
+private:
+	//How a state was reached: the state before it and the keys pressed for the frame
+	struct Link {
+		int parent; //-1 for the start
+		unsigned short keys;
+	};
+
+	//A state waiting to be run
+	struct Open {
+		CompactChip8 state;
+		Link link;
+		int node; //Index in nodes once added
+		int depth;
+		int score; //Addresses no state had run before this one did
+	};
+
+	struct Target {
+		std::string name;
+		std::function<bool(const Chip8&)> test;
+		std::atomic<bool> found;
+		Link link;
+	};
+
+	Chip8 start;
+	Settings settings;
+	std::vector<std::unique_ptr<Target>> targets;
+	std::atomic<int> targetsLeft;
+
+	//Seen set. Open addressing over hashes, 0 marks an empty slot
+	std::unique_ptr<std::atomic<unsigned long long>[]> seen;
+	unsigned long long seenMask;
+
+	//Every distinct state, for walking the input back
+	std::vector<Link> nodes;
+
+	//States waiting to be run, a heap in settings.order
+	std::vector<Open> open;
+	std::mutex lock;
+	std::condition_variable wakeup;
+	int busy; //Threads running a state
+	int level; //BreadthFirst: depth being run. Deeper states wait until it's done
+	bool truncated; //A state was not run for being maxFrames deep
+
+	//First input to run each address
+	std::atomic<unsigned char> coveredAt[4096];
+	Link coverage[4096];
+
+	std::atomic<bool> running;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned long long> states;
+	std::atomic<unsigned long long> frames;
+	std::atomic<int> depth;
+	std::atomic<int> covered;
+	Report report;
+
+	bool insert(unsigned long long hash);
+	bool before(const Open& a, const Open& b) const;
+	bool take(Open& out);
+	void work();
+	void expand(CompactRunner& runner, const Open& from, std::vector<Open>& children,
+		unsigned char* visited, unsigned char* reported, Chip8& full);
+	void walk(Link link, std::vector<unsigned short>& inputs) const;
+};
@@ -0,0 +1,139 @@
+#include "GridView.h"
+#include "Trace.h"
+
+#include <imgui.h>
+#include <GL/gl3w.h>
+
+#include <stdio.h>
+
+GridView::GridView() : dirty(0), texture(0) {
+}
+
+void GridView::init() {
+	pixels.assign(ATLAS_WIDTH * ATLAS_HEIGHT * 3, 0);
+
+	GLuint id;
+	glGenTextures(1, &id);
+	texture = id;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+void GridView::cleanup() {
+	GLuint id = texture;
+	if (id) glDeleteTextures(1, &id);
+	texture = 0;
+}
+
+void GridView::start(const Chip8& core, int count) {
+	if (count > MAX_INSTANCES) count = MAX_INSTANCES;
+	instances.assign(count, core);
+	for (int i = 0; i < count; i++) {
+		instances[i].seedRandom(0x9e3779b9u * (i + 1));
+	}
+	dirty = count == MAX_INSTANCES ? ~0ull : (1ull << count) - 1;
+}
+
+void GridView::stop() {
+	instances.clear();
+	dirty = 0;
+}
+
+void GridView::runFrame() {
+	TRACE_SCOPE("Grid frame");
+	for (int i = 0; i < (int)instances.size(); i++) {
+		if (instances[i].runFrame(fusion)) dirty |= 1ull << i;
+	}
+}
+
+/// <summary>
+/// Unpack an instance's screen into its tile of the CPU side atlas
+/// </summary>
+void GridView::unpackTile(int index) {
+	const unsigned char* screen = instances[index].getScreen();
+	int x0 = (index % ATLAS_COLUMNS) * TILE_WIDTH;
+	int y0 = (index / ATLAS_COLUMNS) * TILE_HEIGHT;
+
+	for (int y = 0; y < TILE_HEIGHT; y++) {
+		unsigned char* out = &pixels[((y0 + y) * ATLAS_WIDTH + x0) * 3];
+		for (int b = 0; b < 8; b++) {
+			unsigned char bits = screen[y * 8 + b];
+			for (int bit = 7; bit >= 0; bit--) {
+				unsigned char value = (bits >> bit) & 1 ? 255 : 0;
+				out[0] = value;
+				out[1] = value;
+				out[2] = value;
+				out += 3;
+			}
+		}
+	}
+}
+
+int GridView::upload() {
+	if (dirty == 0 || texture == 0) return 0;
+	TRACE_SCOPE("Grid upload");
+
+	//the rectangle of tiles around everything that changed
+	int minCol = ATLAS_COLUMNS, maxCol = -1;
+	int minRow = MAX_INSTANCES, maxRow = -1;
+	for (int i = 0; i < (int)instances.size(); i++) {
+		if (((dirty >> i) & 1) == 0) continue;
+		unpackTile(i);
+		int col = i % ATLAS_COLUMNS;
+		int row = i / ATLAS_COLUMNS;
+		if (col < minCol) minCol = col;
+		if (col > maxCol) maxCol = col;
+		if (row < minRow) minRow = row;
+		if (row > maxRow) maxRow = row;
+	}
+	dirty = 0;
+	if (maxCol < 0) return 0;
+
+	int x = minCol * TILE_WIDTH;
+	int y = minRow * TILE_HEIGHT;
+	int width = (maxCol - minCol + 1) * TILE_WIDTH;
+	int height = (maxRow - minRow + 1) * TILE_HEIGHT;
+
+	//one upload straight out of the full size copy
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, ATLAS_WIDTH);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[(y * ATLAS_WIDTH + x) * 3]);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	return width * height * 3;
+}
+
+void GridView::draw(float scale) {
+	ImVec2 tile(TILE_WIDTH * scale, TILE_HEIGHT * scale);
+	const float gap = 4;
+
+	int perRow = (int)((ImGui::GetContentRegionAvail().x + gap) / (tile.x + gap));
+	if (perRow < 1) perRow = 1;
+	int count = (int)instances.size();
+	int rows = (count + perRow - 1) / perRow;
+
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImTextureID id = (ImTextureID)(size_t)texture;
+
+	//every image first and the labels after, so ImGui can merge the
+	//images into one draw call instead of switching to the font texture
+	for (int i = 0; i < count; i++) {
+		ImVec2 min(origin.x + (i % perRow) * (tile.x + gap), origin.y + (i / perRow) * (tile.y + gap));
+		ImVec2 max(min.x + tile.x, min.y + tile.y);
+		ImVec2 uv0((float)((i % ATLAS_COLUMNS) * TILE_WIDTH) / ATLAS_WIDTH, (float)((i / ATLAS_COLUMNS) * TILE_HEIGHT) / ATLAS_HEIGHT);
+		ImVec2 uv1(uv0.x + (float)TILE_WIDTH / ATLAS_WIDTH, uv0.y + (float)TILE_HEIGHT / ATLAS_HEIGHT);
+		drawList->AddImage(id, min, max, uv0, uv1);
+	}
+	char label[8];
+	for (int i = 0; i < count; i++) {
+		ImVec2 at(origin.x + (i % perRow) * (tile.x + gap) + 2, origin.y + (i / perRow) * (tile.y + gap) + 1);
+		snprintf(label, sizeof(label), "%d", i);
+		drawList->AddText(at, 0xff00ffff, label);
+	}
+
+	//claim the space so the window scrolls and sizes around the grid
+	ImGui::Dummy(ImVec2(perRow * (tile.x + gap) - gap, rows > 0 ? rows * (tile.y + gap) - gap : 0));
+}
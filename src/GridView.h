@@ -0,0 +1,69 @@
+#pragma once
+#include "Chip8.h"
+#include <vector>
+
+/// <summary>
+/// Many machines shown side by side
+/// ===================================================================================
+/// Runs up to MAX_INSTANCES copies of a machine and draws their screens as
+/// a grid of tiles. Every screen lives in one atlas texture, ATLAS_COLUMNS
+/// tiles wide. Each host frame the tiles that changed are unpacked into a
+/// CPU side copy of the atlas and sent to the GPU with a single upload of
+/// the rectangle around them. All tiles share the texture, so ImGui draws
+/// them with one draw call however many there are.
+/// ===================================================================================
+/// </summary>
+class GridView
+{
+public:
+	static const int MAX_INSTANCES = 64;
+	static const int TILE_WIDTH = 64;
+	static const int TILE_HEIGHT = 32;
+	static const int ATLAS_COLUMNS = 8;
+	static const int ATLAS_WIDTH = TILE_WIDTH * ATLAS_COLUMNS;
+	static const int ATLAS_HEIGHT = TILE_HEIGHT * (MAX_INSTANCES / ATLAS_COLUMNS);
+
+	GridView();
+
+	/// <summary>
+	/// Create the atlas texture. Needs the GL context
+	/// </summary>
+	void init();
+	void cleanup();
+
+	/// <summary>
+	/// Replace the instances with count copies of core. Each copy gets its
+	/// own random seed so they don't all play the same game
+	/// </summary>
+	void start(const Chip8& core, int count);
+	void stop();
+	bool isRunning() const { return !instances.empty(); }
+	int getCount() const { return (int)instances.size(); }
+
+	/// <summary>
+	/// Run every instance for one 60hz frame
+	/// </summary>
+	void runFrame();
+
+	/// <summary>
+	/// Send the tiles that changed since the last call to the atlas
+	/// </summary>
+	/// <returns>bytes uploaded</returns>
+	int upload();
+
+	/// <summary>
+	/// Draw the tiles into the current ImGui window, as many per row as fit
+	/// </summary>
+	/// <param name="scale">screen pixels per Chip-8 pixel</param>
+	void draw(float scale);
+
+private:
+	std::vector<Chip8> instances;
+	FusionTable fusion; //Shared, every instance runs the same ROM
+	unsigned long long dirty; //Bit n set if instance n drew since the last upload
+
+	unsigned int texture;
+	std::vector<unsigned char> pixels; //RGB copy of the atlas
+
+	void unpackTile(int index);
+};
@@ -0,0 +1,61 @@
+#include "InputQueue.h"
+#include "Chip8.h"
+
+InputQueue::InputQueue() {
+	clear();
+}
+
+void InputQueue::clear() {
+	head = 0;
+	count = 0;
+}
+
+bool InputQueue::push(Event e) {
+	if (count == CAPACITY) return false;
+
+	if (count > 0) {
+		const Event& last = events[(head + count - 1) % CAPACITY];
+		if (e.cycle < last.cycle) e.cycle = last.cycle;
+	}
+
+	//a press and its release on the same cycle would cancel out before
+	//the program ever saw the key, so undoing a queued change waits a cycle
+	for (int i = count - 1; i >= 0; i--) {
+		const Event& queued = events[(head + i) % CAPACITY];
+		if (queued.key != e.key) continue;
+		if (queued.pressed != e.pressed && e.cycle <= queued.cycle) e.cycle = queued.cycle + 1;
+		break;
+	}
+
+	events[(head + count) % CAPACITY] = e;
+	count++;
+	return true;
+}
+
+double InputQueue::applyDue(Chip8& core) {
+	double earliest = -1;
+	unsigned long long now = core.getTime();
+	unsigned short changed = 0; //Keys set by this call
+
+	while (count > 0 && events[head].cycle <= now) {
+		const Event& e = events[head];
+		//an instruction can take more than one cycle (Vip timing). the
+		//one about to run sees this key before it changes again
+		if (changed & (1 << e.key)) break;
+		changed |= 1 << e.key;
+		core.setKey(e.key, e.pressed);
+		if (earliest < 0) earliest = e.hostTime;
+
+		head = (head + 1) % CAPACITY;
+		count--;
+	}
+	return earliest;
+}
+
+void InputQueue::flush(Chip8& core) {
+	while (count > 0) {
+		core.setKey(events[head].key, events[head].pressed);
+		head = (head + 1) % CAPACITY;
+		count--;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+class Chip8;
+
+/// <summary>
+/// Queue of timestamped key events
+/// ===================================================================================
+/// The frontend converts each host key event to the emulated cycle it
+/// happened at and pushes it here. applyDue() is called before every
+/// instruction and hands the core each event exactly when its cycle comes up,
+/// so presses and releases inside one poll batch no longer collapse.
+/// ===================================================================================
+/// </summary>
+class InputQueue
+{
+public:
+	struct Event {
+		unsigned long long cycle; //Emulated time (Chip8::getTime) the event takes effect at
+		double hostTime; //Host time of the event in milliseconds
+		unsigned char key; //0x0 - 0xF
+		bool pressed;
+	};
+
+	InputQueue();
+
+	/// <summary>
+	/// Add an event to the back of the queue. Events are kept in cycle order,
+	/// an event stamped earlier than the one before it is moved up to that cycle.
+	/// An event undoing a queued one for the same key goes at least a cycle later
+	/// </summary>
+	/// <returns>false if the queue is full</returns>
+	bool push(Event e);
+
+	/// <summary>
+	/// Apply every event due at or before the current emulated time of core.
+	/// Stops before a second event for the same key, which waits for the
+	/// next call so at least one instruction sees each state
+	/// </summary>
+	/// <returns>host time of the earliest event applied, or a negative value if none were</returns>
+	double applyDue(Chip8& core);
+
+	/// <summary>
+	/// Apply everything left in the queue, regardless of cycle
+	/// </summary>
+	void flush(Chip8& core);
+
+	void clear();
+	bool empty() const { return count == 0; }
+
+	/// <summary>
+	/// Cycle of the next pending event. Only valid when not empty
+	/// </summary>
+	unsigned long long nextCycle() const { return events[head].cycle; }
+
+private:
+	static const int CAPACITY = 256;
+
+	Event events[CAPACITY];
+	int head;
+	int count;
+};
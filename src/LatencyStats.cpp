@@ -0,0 +1,58 @@
+#include "LatencyStats.h"
+#include <algorithm>
+
+LatencyStats::LatencyStats() {
+	reset();
+}
+
+void LatencyStats::reset() {
+	next = 0;
+	count = 0;
+	pendingSince = -1;
+	changed = false;
+}
+
+void LatencyStats::keyApplied(double hostTime) {
+	if (pendingSince < 0) {
+		pendingSince = hostTime;
+		changed = false;
+	}
+}
+
+void LatencyStats::screenChanged() {
+	if (pendingSince >= 0) changed = true;
+}
+
+void LatencyStats::framePresented(double hostTime) {
+	if (pendingSince < 0 || !changed) return;
+
+	samples[next] = (float)(hostTime - pendingSince);
+	next = (next + 1) % MAX_SAMPLES;
+	if (count < MAX_SAMPLES) count++;
+
+	pendingSince = -1;
+	changed = false;
+}
+
+float LatencyStats::percentile(float p) const {
+	if (count == 0) return 0;
+
+	float sorted[MAX_SAMPLES];
+	std::copy(samples, samples + count, sorted);
+
+	int index = (int)(p / 100.0f * (count - 1) + 0.5f);
+	if (index < 0) index = 0;
+	if (index >= count) index = count - 1;
+
+	std::nth_element(sorted, sorted + index, sorted + count);
+	return sorted[index];
+}
+
+int LatencyStats::getSamples(float* out, int maxOut) const {
+	int n = std::min(count, maxOut);
+	int start = (next - n + MAX_SAMPLES) % MAX_SAMPLES;
+	for (int i = 0; i < n; i++) {
+		out[i] = samples[(start + i) % MAX_SAMPLES];
+	}
+	return n;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/// <summary>
+/// Input to photon latency measurement
+/// ===================================================================================
+/// The frontend reports when a key event reaches the core, when the core
+/// changes the screen after that, and when a frame is presented. The time
+/// from the key event to the first presented frame showing a change is
+/// kept as a sample.
+/// ===================================================================================
+/// </summary>
+class LatencyStats
+{
+public:
+	static const int MAX_SAMPLES = 512;
+
+	LatencyStats();
+
+	/// <summary>
+	/// A key event from hostTime was applied to the core. If we are already
+	/// waiting on an earlier event, that one is kept
+	/// </summary>
+	void keyApplied(double hostTime);
+
+	/// <summary>
+	/// The core drew something after the last applied key event
+	/// </summary>
+	void screenChanged();
+
+	/// <summary>
+	/// A frame was presented at hostTime
+	/// </summary>
+	void framePresented(double hostTime);
+
+	void reset();
+
+	/// <summary>
+	/// Latency in milliseconds at percentile p (0 - 100) over the kept samples
+	/// </summary>
+	float percentile(float p) const;
+
+	int getCount() const { return count; }
+	/// <summary>
+	/// Samples in the order they were taken, oldest first
+	/// </summary>
+	int getSamples(float* out, int maxOut) const;
+
+private:
+	float samples[MAX_SAMPLES];
+	int next;
+	int count;
+
+	double pendingSince; //Host time of the key event we are waiting on. negative if none
+	bool changed;
+};
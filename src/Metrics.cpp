@@ -0,0 +1,229 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace {
+	std::atomic<unsigned int> nextRegistry(1);
+
+	void appendNumber(std::string& out, double value) {
+		char text[32];
+		snprintf(text, sizeof(text), "%.17g", value);
+		out += text;
+	}
+}
+
+Metrics::Metrics() : count(0), summaryCount(0) {
+	registry = nextRegistry.fetch_add(1);
+	for (int i = 0; i < MAX_METRICS; i++) {
+		gauges[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+int Metrics::addMetric(const char* name, const char* help, Type type) {
+	std::lock_guard<std::mutex> guard(lock);
+	int id = count.load(std::memory_order_relaxed);
+	if (id == MAX_METRICS) return -1;
+	if (type == Type::Summary && summaryCount == MAX_SUMMARIES) return -1;
+
+	Metric& m = metrics[id];
+	m.name = name;
+	m.help = help;
+	m.type = type;
+	m.slot = type == Type::Summary ? summaryCount++ : -1;
+
+	//readers only look at metrics below count
+	count.store(id + 1, std::memory_order_release);
+	return id;
+}
+
+int Metrics::addCounter(const char* name, const char* help) {
+	return addMetric(name, help, Type::Counter);
+}
+
+int Metrics::addGauge(const char* name, const char* help) {
+	return addMetric(name, help, Type::Gauge);
+}
+
+int Metrics::addSummary(const char* name, const char* help) {
+	return addMetric(name, help, Type::Summary);
+}
+
+int Metrics::getCount() const {
+	return count.load(std::memory_order_acquire);
+}
+
+Metrics::Shard& Metrics::shard() {
+	//the last registry and shard this thread used. one registry is the normal case
+	thread_local unsigned int cachedRegistry = 0;
+	thread_local Shard* cachedShard = nullptr;
+	if (cachedRegistry == registry) return *cachedShard;
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::thread::id self = std::this_thread::get_id();
+	Shard* found = nullptr;
+	for (const std::unique_ptr<Shard>& s : shards) {
+		if (s->owner == self) found = s.get();
+	}
+	if (!found) {
+		shards.emplace_back(new Shard());
+		found = shards.back().get();
+		found->owner = self;
+		for (int i = 0; i < MAX_METRICS; i++) {
+			found->counters[i].store(0, std::memory_order_relaxed);
+		}
+		for (int i = 0; i < MAX_SUMMARIES; i++) {
+			found->summaries[i].count.store(0, std::memory_order_relaxed);
+			found->summaries[i].sum.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	cachedRegistry = registry;
+	cachedShard = found;
+	return *found;
+}
+
+void Metrics::add(int id, unsigned long long n) {
+	if (id < 0) return;
+	//this thread is the only writer, no need for an atomic add
+	std::atomic<unsigned long long>& counter = shard().counters[id];
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void Metrics::set(int id, double value) {
+	if (id < 0) return;
+	gauges[id].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::observe(int id, float value) {
+	if (id < 0) return;
+	Summary& s = shard().summaries[metrics[id].slot];
+	unsigned long long n = s.count.load(std::memory_order_relaxed);
+	s.samples[n % MAX_SAMPLES].store(value, std::memory_order_relaxed);
+	s.sum.store(s.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	//publishes the sample to readers
+	s.count.store(n + 1, std::memory_order_release);
+}
+
+double Metrics::get(int id) const {
+	if (!valid(id)) return 0;
+	switch (metrics[id].type) {
+	case Type::Gauge:
+		return gauges[id].load(std::memory_order_relaxed);
+	case Type::Counter: {
+		std::lock_guard<std::mutex> guard(lock);
+		unsigned long long total = 0;
+		for (const std::unique_ptr<Shard>& s : shards) {
+			total += s->counters[id].load(std::memory_order_relaxed);
+		}
+		return (double)total;
+	}
+	case Type::Summary: {
+		std::lock_guard<std::mutex> guard(lock);
+		unsigned long long total = 0;
+		for (const std::unique_ptr<Shard>& s : shards) {
+			total += s->summaries[metrics[id].slot].count.load(std::memory_order_acquire);
+		}
+		return (double)total;
+	}
+	}
+	return 0;
+}
+
+float Metrics::percentile(int id, float p) const {
+	if (!valid(id) || metrics[id].type != Type::Summary) return 0;
+	int slot = metrics[id].slot;
+
+	std::vector<float> sorted;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (const std::unique_ptr<Shard>& s : shards) {
+			const Summary& summary = s->summaries[slot];
+			unsigned long long n = summary.count.load(std::memory_order_acquire);
+			int kept = (int)std::min<unsigned long long>(n, MAX_SAMPLES);
+			for (int i = 0; i < kept; i++) {
+				sorted.push_back(summary.samples[i].load(std::memory_order_relaxed));
+			}
+		}
+	}
+	if (sorted.empty()) return 0;
+
+	int n = (int)sorted.size();
+	int index = (int)(p / 100.0f * (n - 1) + 0.5f);
+	if (index < 0) index = 0;
+	if (index >= n) index = n - 1;
+
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
+
+std::string Metrics::format() const {
+	static const char* types[] = { "counter", "gauge", "summary" };
+	static const float quantiles[] = { 0.5f, 0.9f, 0.99f };
+
+	std::string out;
+	int n = getCount();
+	for (int id = 0; id < n; id++) {
+		const Metric& m = metrics[id];
+		out += "# HELP " + m.name + " " + m.help + "\n";
+		out += "# TYPE " + m.name + " " + types[(int)m.type] + "\n";
+
+		if (m.type != Type::Summary) {
+			out += m.name + " ";
+			appendNumber(out, get(id));
+			out += "\n";
+			continue;
+		}
+
+		for (float q : quantiles) {
+			char label[32];
+			snprintf(label, sizeof(label), "{quantile=\"%g\"} ", q);
+			out += m.name + label;
+			appendNumber(out, percentile(id, q * 100));
+			out += "\n";
+		}
+
+		double sum = 0;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (const std::unique_ptr<Shard>& s : shards) {
+				sum += s->summaries[m.slot].sum.load(std::memory_order_relaxed);
+			}
+		}
+		out += m.name + "_sum ";
+		appendNumber(out, sum);
+		out += "\n" + m.name + "_count ";
+		appendNumber(out, get(id));
+		out += "\n";
+	}
+	return out;
+}
+
+bool Metrics::writeFile(const char* path) const {
+	std::string text = format();
+	std::string temp = std::string(path) + ".tmp";
+
+	std::ofstream fs(temp.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	fs.write(text.data(), text.size());
+	fs.close();
+	if (!fs) {
+		remove(temp.c_str());
+		return false;
+	}
+
+	//Replace the old file in one step, so there is always a whole one at path
+#ifdef _WIN32
+	if (!MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+	if (rename(temp.c_str(), path) != 0) {
+#endif
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
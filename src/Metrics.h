@@ -0,0 +1,123 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Registry of named counters, gauges and summaries
+/// ===================================================================================
+/// Metrics are registered once at startup and then updated by id. The
+/// current values can be read back at any time, or written out in the
+/// Prometheus text format for a node exporter textfile collector.
+///
+/// Counters and summaries are kept per thread. Each thread that updates
+/// one gets its own shard on first use and is the only writer to it, so
+/// an update is a plain load and store, no locked instruction and no
+/// shared cache line. Readers add the shards up when asked. Gauges are
+/// last writer wins and live in the registry itself.
+/// ===================================================================================
+/// </summary>
+class Metrics
+{
+public:
+	static const int MAX_METRICS = 32;
+	static const int MAX_SUMMARIES = 4;
+	//Most recent observations kept per summary, per thread
+	static const int MAX_SAMPLES = 256;
+
+	enum class Type {
+		Counter, //Only goes up
+		Gauge, //Set to a value
+		Summary //Observations, reported as quantiles
+	};
+
+	Metrics();
+
+	/// <summary>
+	/// Register a metric. name must follow the Prometheus rules
+	/// ([a-zA-Z_:][a-zA-Z0-9_:]*), counters should end in _total
+	/// </summary>
+	/// <returns>the id to update it with, or -1 if the registry is full</returns>
+	int addCounter(const char* name, const char* help);
+	int addGauge(const char* name, const char* help);
+	int addSummary(const char* name, const char* help);
+
+	/// <summary>
+	/// Add to a counter from the calling thread
+	/// </summary>
+	void add(int id, unsigned long long n = 1);
+	void set(int id, double value);
+	/// <summary>
+	/// Record one observation of a summary from the calling thread
+	/// </summary>
+	void observe(int id, float value);
+
+	int getCount() const;
+	/// <summary>
+	/// The getters take any id, those not registered (including the -1
+	/// from a full registry) read as an empty counter
+	/// </summary>
+	const char* getName(int id) const { return valid(id) ? metrics[id].name.c_str() : ""; }
+	Type getType(int id) const { return valid(id) ? metrics[id].type : Type::Counter; }
+
+	/// <summary>
+	/// Counter summed over all threads, gauge value, or number of
+	/// observations of a summary
+	/// </summary>
+	double get(int id) const;
+	/// <summary>
+	/// Value at percentile p (0 - 100) over the kept observations of a summary
+	/// </summary>
+	float percentile(int id, float p) const;
+
+	/// <summary>
+	/// Every metric in the Prometheus text exposition format
+	/// </summary>
+	std::string format() const;
+	/// <summary>
+	/// Write format() to a file. Goes through a temporary file so a
+	/// collector never sees half of it
+	/// </summary>
+	bool writeFile(const char* path) const;
+
+private:
+	struct Metric {
+		std::string name;
+		std::string help;
+		Type type;
+		int slot; //Summary storage index, -1 for other types
+	};
+
+	struct Summary {
+		std::atomic<unsigned long long> count;
+		std::atomic<double> sum;
+		std::atomic<float> samples[MAX_SAMPLES];
+	};
+
+	struct Shard {
+		std::thread::id owner;
+		std::atomic<unsigned long long> counters[MAX_METRICS];
+		Summary summaries[MAX_SUMMARIES];
+	};
+
+	//Only written while holding lock, before the metric is first used
+	Metric metrics[MAX_METRICS];
+	std::atomic<int> count;
+	int summaryCount;
+
+	std::atomic<double> gauges[MAX_METRICS];
+
+	unsigned int registry; //Tells this registry apart in the per thread cache
+	mutable std::mutex lock;
+	std::vector<std::unique_ptr<Shard>> shards;
+
+	int addMetric(const char* name, const char* help, Type type);
+	/// <summary>
+	/// The calling thread's shard. Only locks the first time a thread asks
+	/// </summary>
+	Shard& shard();
+	bool valid(int id) const { return id >= 0 && id < getCount(); }
+};
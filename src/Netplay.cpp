@@ -0,0 +1,472 @@
+#include "Netplay.h"
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#define INVALID_SOCK ((long long)INVALID_SOCKET)
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define INVALID_SOCK (-1LL)
+#endif
+
+//'C8NP'
+#define PACKET_MAGIC 0x504e3843
+#define PACKET_HEADER 13
+//'C8NH'
+#define HELLO_MAGIC 0x484e3843
+#define HELLO_SIZE 17
+
+/// <summary>
+/// Packets are little endian. Input:
+/// magic (4) | first frame (4) | ack (4) | count (1) | count keymasks (2 each)
+/// Handshake:
+/// magic (4) | start machine hash (8) | seed half (4) | answer (1)
+/// </summary>
+namespace {
+	void put32(unsigned char* p, unsigned int v) {
+		p[0] = v & 0xff;
+		p[1] = (v >> 8) & 0xff;
+		p[2] = (v >> 16) & 0xff;
+		p[3] = (v >> 24) & 0xff;
+	}
+
+	unsigned int get32(const unsigned char* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+	}
+
+	void put64(unsigned char* p, unsigned long long v) {
+		put32(p, (unsigned int)v);
+		put32(p + 4, (unsigned int)(v >> 32));
+	}
+
+	unsigned long long get64(const unsigned char* p) {
+		return get32(p) | ((unsigned long long)get32(p + 4) << 32);
+	}
+
+	void keysToCore(Chip8& core, unsigned short keys) {
+		for (int i = 0; i < 16; i++) {
+			core.setKey(i, (keys >> i) & 1);
+		}
+	}
+}
+
+UdpTransport::UdpTransport() {
+	sock = INVALID_SOCK;
+	memset(remoteAddr, 0, sizeof(remoteAddr));
+}
+
+UdpTransport::~UdpTransport() {
+	close();
+}
+
+bool UdpTransport::open(unsigned short localPort, const char* remoteHost, unsigned short remotePort) {
+	close();
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+#endif
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* result = NULL;
+	if (getaddrinfo(remoteHost, NULL, &hints, &result) != 0 || result == NULL) return false;
+
+	sockaddr_in remote;
+	memcpy(&remote, result->ai_addr, sizeof(remote));
+	remote.sin_port = htons(remotePort);
+	memcpy(remoteAddr, &remote, sizeof(remote));
+	freeaddrinfo(result);
+
+	long long s = (long long)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCK) return false;
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(localPort);
+
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	bool ok = bind((SOCKET)s, (sockaddr*)&local, sizeof(local)) == 0
+		&& ioctlsocket((SOCKET)s, FIONBIO, &nonBlocking) == 0;
+	if (!ok) {
+		closesocket((SOCKET)s);
+		return false;
+	}
+#else
+	bool ok = bind((int)s, (sockaddr*)&local, sizeof(local)) == 0
+		&& fcntl((int)s, F_SETFL, fcntl((int)s, F_GETFL, 0) | O_NONBLOCK) == 0;
+	if (!ok) {
+		::close((int)s);
+		return false;
+	}
+#endif
+
+	sock = s;
+	return true;
+}
+
+void UdpTransport::close() {
+	if (sock == INVALID_SOCK) return;
+#ifdef _WIN32
+	closesocket((SOCKET)sock);
+	WSACleanup();
+#else
+	::close((int)sock);
+#endif
+	sock = INVALID_SOCK;
+}
+
+bool UdpTransport::isOpen() const {
+	return sock != INVALID_SOCK;
+}
+
+bool UdpTransport::send(const unsigned char* data, int len) {
+	if (sock == INVALID_SOCK) return false;
+#ifdef _WIN32
+	return sendto((SOCKET)sock, (const char*)data, len, 0, (const sockaddr*)remoteAddr, sizeof(sockaddr_in)) == len;
+#else
+	return sendto((int)sock, data, len, 0, (const sockaddr*)remoteAddr, sizeof(sockaddr_in)) == len;
+#endif
+}
+
+int UdpTransport::receive(unsigned char* data, int maxLen) {
+	if (sock == INVALID_SOCK) return 0;
+
+	sockaddr_in from;
+	socklen_t fromLen = sizeof(from);
+#ifdef _WIN32
+	int len = recvfrom((SOCKET)sock, (char*)data, maxLen, 0, (sockaddr*)&from, &fromLen);
+#else
+	int len = (int)recvfrom((int)sock, data, maxLen, 0, (sockaddr*)&from, &fromLen);
+#endif
+	if (len <= 0) return 0;
+
+	//only listen to our peer
+	const sockaddr_in* remote = (const sockaddr_in*)remoteAddr;
+	if (from.sin_addr.s_addr != remote->sin_addr.s_addr || from.sin_port != remote->sin_port) return 0;
+	return len;
+}
+
+LoopbackLink::LoopbackLink(int latencyFrames, int jitterFrames, int lossPercent, unsigned int seed)
+	: a(*this, toB, toA), b(*this, toA, toB) {
+	now = 0;
+	this->latencyFrames = latencyFrames;
+	this->jitterFrames = jitterFrames;
+	this->lossPercent = lossPercent;
+	rng = seed != 0 ? seed : 1;
+}
+
+unsigned int LoopbackLink::nextRandom() {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+LoopbackLink::Endpoint::Endpoint(LoopbackLink& link, std::vector<Packet>& outbox, std::vector<Packet>& inbox)
+	: link(link), outbox(outbox), inbox(inbox) {
+}
+
+bool LoopbackLink::Endpoint::send(const unsigned char* data, int len) {
+	//a lost packet still counts as sent, same as UDP
+	if ((int)(link.nextRandom() % 100) < link.lossPercent) return true;
+
+	Packet p;
+	p.deliverAt = link.now + link.latencyFrames;
+	if (link.jitterFrames > 0) p.deliverAt += link.nextRandom() % (link.jitterFrames + 1);
+	p.data.assign(data, data + len);
+	outbox.push_back(p);
+	return true;
+}
+
+int LoopbackLink::Endpoint::receive(unsigned char* data, int maxLen) {
+	//jitter can reorder packets, hand out the first one that has arrived
+	for (size_t i = 0; i < inbox.size(); i++) {
+		if (inbox[i].deliverAt > link.now) continue;
+
+		int len = (int)inbox[i].data.size();
+		if (len > maxLen) len = maxLen;
+		memcpy(data, inbox[i].data.data(), len);
+		inbox.erase(inbox.begin() + i);
+		return len;
+	}
+	return 0;
+}
+
+NetSession::NetSession() : states(RING) {
+	transport = NULL;
+	startHash = 0;
+	seed = 0;
+	stop();
+}
+
+void NetSession::start(NetTransport& transport, const Chip8& initial, unsigned int seed) {
+	stop();
+	this->transport = &transport;
+	core = initial;
+	state = State::Connecting;
+	startHash = initial.hash();
+	this->seed = seed;
+
+	for (int i = 0; i < RING; i++) {
+		localInput[i] = 0;
+		remoteInput[i] = 0;
+		usedRemote[i] = 0;
+	}
+}
+
+void NetSession::stop() {
+	transport = NULL;
+	state = State::Connecting;
+	frame = 0;
+	remoteConfirmed = 0;
+	peerAck = 0;
+	localSet = 0;
+	rollbackFrom = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool NetSession::advanceFrame(unsigned short localKeys) {
+	if (transport == NULL) return false;
+
+	receiveInput();
+
+	//nothing runs before both peers agree on the start. the peer answers
+	//every hello, so keep sending until it does
+	if (state != State::Running) {
+		if (state == State::Connecting) sendHello(false);
+		return false;
+	}
+
+	//too far ahead of the remote peer. a rollback this deep would be
+	//too expensive and would overrun our ring, so wait for it
+	if (frame >= remoteConfirmed + MAX_ROLLBACK) {
+		sendInput();
+		stats.stalls++;
+		return false;
+	}
+
+	localInput[frame % RING] = localKeys;
+	localSet = frame + 1;
+	sendInput();
+
+	if (rollbackFrom < frame) {
+		unsigned int depth = frame - rollbackFrom;
+		stats.rollbacks++;
+		stats.resimulatedFrames += depth;
+		if (depth > stats.maxRollback) stats.maxRollback = depth;
+
+		//frames after the first wrong one were run from a wrong machine,
+		//so everything from there gets run again
+		core = states[rollbackFrom % RING];
+		for (unsigned int f = rollbackFrom; f < frame; f++) {
+			simulate(f);
+		}
+	}
+
+	simulate(frame);
+	frame++;
+	rollbackFrom = frame;
+	return true;
+}
+
+void NetSession::simulate(unsigned int f) {
+	unsigned short remote;
+	if (f < remoteConfirmed) {
+		remote = remoteInput[f % RING];
+	}
+	else {
+		//predict the remote player is still holding what they held last
+		remote = remoteConfirmed > 0 ? remoteInput[(remoteConfirmed - 1) % RING] : 0;
+	}
+
+	states[f % RING] = core;
+	usedRemote[f % RING] = remote;
+	keysToCore(core, localInput[f % RING] | remote);
+	core.runFrame(fusion);
+}
+
+/// <param name="answer">true when replying to the peer's hello, which needs no reply back</param>
+void NetSession::sendHello(bool answer) {
+	unsigned char packet[HELLO_SIZE];
+	put32(packet, HELLO_MAGIC);
+	put64(packet + 4, startHash);
+	put32(packet + 12, seed);
+	packet[16] = answer ? 1 : 0;
+	transport->send(packet, HELLO_SIZE);
+	stats.packetsSent++;
+}
+
+void NetSession::sendInput() {
+	//resend everything the peer hasn't acknowledged, so a lost packet
+	//is covered by the next one
+	unsigned int first = peerAck;
+	if (localSet - first > MAX_PACKET_FRAMES) first = localSet - MAX_PACKET_FRAMES;
+	unsigned int count = localSet - first;
+
+	unsigned char packet[PACKET_HEADER + 2 * MAX_PACKET_FRAMES];
+	put32(packet, PACKET_MAGIC);
+	put32(packet + 4, first);
+	put32(packet + 8, remoteConfirmed);
+	packet[12] = (unsigned char)count;
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned short keys = localInput[(first + i) % RING];
+		packet[PACKET_HEADER + i * 2] = keys & 0xff;
+		packet[PACKET_HEADER + i * 2 + 1] = keys >> 8;
+	}
+
+	transport->send(packet, PACKET_HEADER + 2 * count);
+	stats.packetsSent++;
+}
+
+void NetSession::receiveInput() {
+	unsigned char packet[512];
+	int len;
+
+	while ((len = transport->receive(packet, sizeof(packet))) > 0) {
+		if (len == HELLO_SIZE && get32(packet) == HELLO_MAGIC) {
+			stats.packetsReceived++;
+			if (get64(packet + 4) != startHash) {
+				state = State::Mismatch;
+			}
+			else if (state == State::Connecting) {
+				//both peers combine the same two halves
+				core.seedRandom(seed ^ get32(packet + 12));
+				state = State::Running;
+			}
+			//the peer is still waiting for our hello, mismatched or not
+			if (packet[16] == 0) sendHello(true);
+			continue;
+		}
+		if (state == State::Mismatch) continue;
+		if (len < PACKET_HEADER || get32(packet) != PACKET_MAGIC) continue;
+
+		unsigned int first = get32(packet + 4);
+		unsigned int ack = get32(packet + 8);
+		unsigned int count = packet[12];
+		if (len < PACKET_HEADER + 2 * (int)count) continue;
+		stats.packetsReceived++;
+
+		if (ack > peerAck && ack <= localSet) peerAck = ack;
+
+		//only take input in order, gaps get filled by later packets
+		for (unsigned int i = 0; i < count; i++) {
+			unsigned int f = first + i;
+			if (f != remoteConfirmed) continue;
+			if (f >= frame + RING / 2) break;
+
+			unsigned short keys = packet[PACKET_HEADER + i * 2] | (packet[PACKET_HEADER + i * 2 + 1] << 8);
+			remoteInput[f % RING] = keys;
+			remoteConfirmed++;
+
+			if (f < frame && usedRemote[f % RING] != keys && f < rollbackFrom) {
+				rollbackFrom = f;
+			}
+		}
+	}
+}
+
+bool runLoopbackTest(const Chip8& initial, int frames, int latencyFrames, int jitterFrames, int lossPercent, std::string& report) {
+	//sessions keep a ring of machines, too big for the stack
+	std::vector<NetSession> peers(2);
+	LoopbackLink link(latencyFrames, jitterFrames, lossPercent, 0x1234567);
+	const unsigned int seeds[2] = { 0x8badf00d, 0x1c0ffee };
+	peers[0].start(link.getA(), initial, seeds[0]);
+	peers[1].start(link.getB(), initial, seeds[1]);
+
+	//after the scripted part, keep going with no input and no loss
+	//until everything in flight has been confirmed
+	int settle = 2 * (latencyFrames + jitterFrames) + NetSession::MAX_ROLLBACK + 2;
+	int total = frames + settle;
+
+	//scripted input. each player holds a random key for a random while
+	std::vector<unsigned short> input[2];
+	unsigned int rng = 0x9e3779b9;
+	for (int p = 0; p < 2; p++) {
+		input[p].resize(total, 0);
+		unsigned short held = 0;
+		for (int f = 0; f < frames; f++) {
+			rng ^= rng << 13;
+			rng ^= rng >> 17;
+			rng ^= rng << 5;
+			if (rng % 8 == 0) held = (rng >> 8) % 3 == 0 ? 0 : (unsigned short)(1 << ((rng >> 12) % 16));
+			input[p][f] = held;
+		}
+	}
+
+	double worstFrameUs = 0;
+	std::vector<int> next(2, 0);
+	for (int tick = 0; next[0] < total || next[1] < total; tick++) {
+		if (tick == frames) link.setLoss(0);
+		if (tick > total * 4) break;
+
+		for (int p = 0; p < 2; p++) {
+			if (next[p] >= total) continue;
+
+			auto begin = std::chrono::high_resolution_clock::now();
+			if (peers[p].advanceFrame(input[p][next[p]])) next[p]++;
+			double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - begin).count();
+			if (us > worstFrameUs) worstFrameUs = us;
+		}
+		link.tick();
+	}
+
+	//the same input on a single machine
+	Chip8 reference = initial;
+	reference.seedRandom(seeds[0] ^ seeds[1]);
+	for (int f = 0; f < total; f++) {
+		keysToCore(reference, input[0][f] | input[1][f]);
+		reference.runFrame();
+	}
+
+	bool finished = next[0] == total && next[1] == total;
+	bool matchA = peers[0].getCore().hash() == reference.hash();
+	bool matchB = peers[1].getCore().hash() == reference.hash();
+
+	//a peer that ran a frame before starting can't join. both sides must refuse
+	std::vector<NetSession> strangers(2);
+	LoopbackLink strangerLink(latencyFrames, jitterFrames, 0, 0x7654321);
+	Chip8 ahead = initial;
+	ahead.runFrame();
+	strangers[0].start(strangerLink.getA(), initial, seeds[0]);
+	strangers[1].start(strangerLink.getB(), ahead, seeds[1]);
+	bool refused = true;
+	for (int tick = 0; tick < 4 * (latencyFrames + jitterFrames + 1); tick++) {
+		for (int p = 0; p < 2; p++) {
+			if (strangers[p].advanceFrame(0)) refused = false;
+		}
+		strangerLink.tick();
+	}
+	refused = refused && strangers[0].getState() == NetSession::State::Mismatch
+		&& strangers[1].getState() == NetSession::State::Mismatch;
+	bool pass = finished && matchA && matchB && refused;
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"%s: %d frames, latency %d(+%d) frames, %d%% loss\n"
+		"peer A: %s, %u rollbacks, %u frames rerun, deepest %u, %u stalls\n"
+		"peer B: %s, %u rollbacks, %u frames rerun, deepest %u, %u stalls\n"
+		"different start: %s\n"
+		"worst frame: %.1f us\n",
+		pass ? "PASS" : "FAIL", frames, latencyFrames, jitterFrames, lossPercent,
+		matchA ? "in sync" : "DESYNC", peers[0].getStats().rollbacks, peers[0].getStats().resimulatedFrames, peers[0].getStats().maxRollback, peers[0].getStats().stalls,
+		matchB ? "in sync" : "DESYNC", peers[1].getStats().rollbacks, peers[1].getStats().resimulatedFrames, peers[1].getStats().maxRollback, peers[1].getStats().stalls,
+		refused ? "refused" : "NOT REFUSED", worstFrameUs);
+	report = buf;
+
+	return pass;
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include "Chip8.h"
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Rollback netplay for two player ROMs
+/// ===================================================================================
+/// Both players share the one 16 key keypad. Each frame the keypad is the
+/// OR of both players' keymasks.
+///
+/// Every peer runs its own machine and never waits for the other side.
+/// A remote keymask we don't have yet is predicted to be the same as the last
+/// one we got. When the real keymask arrives and it differs from what we
+/// predicted, we restore the machine to the start of that frame and run
+/// forward again with the right input.
+///
+/// The core is deterministic (see Chip8::seedRandom), so both peers end up
+/// with the same machine once all input is confirmed. That needs the same
+/// machine to start from, so no frame runs until a handshake has checked
+/// it: each peer sends the hash of its start machine and half of the
+/// random seed. Both seed the machine with the two halves combined, and a
+/// peer whose hash differs from ours is refused.
+/// ===================================================================================
+/// </summary>
+
+/// <summary>
+/// Something that can send and receive datagrams without blocking
+/// </summary>
+class NetTransport
+{
+public:
+	virtual ~NetTransport() {}
+	virtual bool send(const unsigned char* data, int len) = 0;
+	/// <returns>size of the datagram read, 0 if there was nothing to read</returns>
+	virtual int receive(unsigned char* data, int maxLen) = 0;
+};
+
+/// <summary>
+/// UDP socket talking to a single remote peer
+/// </summary>
+class UdpTransport : public NetTransport
+{
+public:
+	UdpTransport();
+	~UdpTransport();
+
+	bool open(unsigned short localPort, const char* remoteHost, unsigned short remotePort);
+	void close();
+	bool isOpen() const;
+
+	bool send(const unsigned char* data, int len) override;
+	int receive(unsigned char* data, int maxLen) override;
+
+private:
+	long long sock;
+	unsigned char remoteAddr[16]; //sockaddr_in. kept opaque so this header stays platform free
+};
+
+/// <summary>
+/// In memory link between two endpoints for testing. Delivers datagrams
+/// after a given number of frames and drops a given percentage of them
+/// </summary>
+class LoopbackLink
+{
+public:
+	LoopbackLink(int latencyFrames, int jitterFrames, int lossPercent, unsigned int seed);
+
+	NetTransport& getA() { return a; }
+	NetTransport& getB() { return b; }
+
+	/// <summary>
+	/// Advance the link clock by one frame
+	/// </summary>
+	void tick() { now++; }
+
+	void setLoss(int lossPercent) { this->lossPercent = lossPercent; }
+
+private:
+	struct Packet {
+		int deliverAt;
+		std::vector<unsigned char> data;
+	};
+
+	class Endpoint : public NetTransport
+	{
+	public:
+		Endpoint(LoopbackLink& link, std::vector<Packet>& outbox, std::vector<Packet>& inbox);
+		bool send(const unsigned char* data, int len) override;
+		int receive(unsigned char* data, int maxLen) override;
+	private:
+		LoopbackLink& link;
+		std::vector<Packet>& outbox;
+		std::vector<Packet>& inbox;
+	};
+
+	int now;
+	int latencyFrames;
+	int jitterFrames;
+	int lossPercent;
+	unsigned int rng;
+
+	std::vector<Packet> toA;
+	std::vector<Packet> toB;
+	Endpoint a;
+	Endpoint b;
+
+	unsigned int nextRandom();
+};
+
+/// <summary>
+/// One peer of a netplay session
+/// </summary>
+class NetSession
+{
+public:
+	//Furthest we run ahead of the last confirmed remote input
+	static const int MAX_ROLLBACK = 15;
+
+	enum class State {
+		Connecting, //Waiting for the peer's hash and seed
+		Running,
+		Mismatch //The peer started from a different machine
+	};
+
+	NetSession();
+
+	/// <summary>
+	/// Start a session. Both peers must start from the same machine, a fresh
+	/// one with the ROM loaded and nothing run yet. The handshake checks it
+	/// </summary>
+	/// <param name="seed">this peer's half of the random seed, best picked at random</param>
+	void start(NetTransport& transport, const Chip8& initial, unsigned int seed);
+	void stop();
+	bool isRunning() const { return transport != NULL; }
+	State getState() const { return state; }
+
+	/// <summary>
+	/// Run one frame with our keymask for it. Receives and sends input
+	/// and rolls back if an earlier prediction turned out wrong
+	/// </summary>
+	/// <param name="localKeys">bit n set if key n is held</param>
+	/// <returns>false if we are too far ahead of the remote peer and had to wait,
+	/// or the handshake isn't done</returns>
+	bool advanceFrame(unsigned short localKeys);
+
+	const Chip8& getCore() const { return core; }
+	unsigned int getFrame() const { return frame; }
+	unsigned int getConfirmedFrame() const { return remoteConfirmed; }
+
+	struct Stats {
+		unsigned int rollbacks;
+		unsigned int resimulatedFrames;
+		unsigned int maxRollback;
+		unsigned int stalls;
+		unsigned int packetsSent;
+		unsigned int packetsReceived;
+	};
+	const Stats& getStats() const { return stats; }
+
+private:
+	static const int RING = 64;
+	static const int MAX_PACKET_FRAMES = 2 * MAX_ROLLBACK + 2;
+
+	NetTransport* transport;
+	Chip8 core;
+	FusionTable fusion; //Kept across rollbacks, see FusionTable
+	State state;
+	unsigned long long startHash; //Chip8::hash of the machine we started from
+	unsigned int seed; //Our half of the random seed
+
+	unsigned int frame; //Next frame to run
+	unsigned int remoteConfirmed; //Every remote input before this frame is known
+	unsigned int peerAck; //Every local input before this frame has reached the peer
+	unsigned int localSet; //Every local input before this frame has been given to us
+	unsigned int rollbackFrom; //Earliest frame run with a wrong prediction. frame if none
+
+	unsigned short localInput[RING];
+	unsigned short remoteInput[RING];
+	unsigned short usedRemote[RING]; //Remote input each frame was last run with
+	std::vector<Chip8> states; //Machine at the start of each frame
+
+	Stats stats;
+
+	void sendHello(bool answer);
+	void sendInput();
+	void receiveInput();
+	void simulate(unsigned int f);
+};
+
+/// <summary>
+/// Run two sessions against each other over a LoopbackLink with scripted
+/// random input, then check both ended up identical to a plain run of the
+/// same combined input. Also checks two peers starting from different
+/// machines refuse each other
+/// </summary>
+/// <returns>true if neither peer desynced</returns>
+bool runLoopbackTest(const Chip8& initial, int frames, int latencyFrames, int jitterFrames, int lossPercent, std::string& report);
@@ -0,0 +1,26 @@
+#include "RunAhead.h"
+
+RunAhead::RunAhead() {
+	frames = 0;
+	future.initialize();
+}
+
+void RunAhead::setFrames(int frames) {
+	if (frames < 0) frames = 0;
+	if (frames > MAX_FRAMES) frames = MAX_FRAMES;
+	this->frames = frames;
+}
+
+bool RunAhead::run(const Chip8& core, unsigned short keys) {
+	//save state is a plain copy, see Chip8.h
+	future = core;
+	for (int i = 0; i < 16; i++) {
+		future.setKey((unsigned char)i, (keys >> i) & 1);
+	}
+
+	bool drew = false;
+	for (int i = 0; i < frames; i++) {
+		if (future.runFrame(fusion)) drew = true;
+	}
+	return drew;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "Chip8.h"
+
+/// <summary>
+/// Run-ahead input latency reduction
+/// ===================================================================================
+/// Many ROMs poll the keypad with EX9E/EXA1 and only react to a key a frame
+/// or more later. Each host frame we copy the machine, run the copy a few
+/// frames into the future with the keys held right now and show the
+/// screen of the copy instead. The real machine is never touched, so
+/// throwing the copy away is the rollback.
+/// ===================================================================================
+/// </summary>
+class RunAhead
+{
+public:
+	static const int MAX_FRAMES = 8;
+
+	RunAhead();
+
+	void setFrames(int frames);
+	int getFrames() const { return frames; }
+	bool isEnabled() const { return frames > 0; }
+
+	/// <summary>
+	/// Speculatively run a copy of core for the configured number of frames
+	/// </summary>
+	/// <param name="keys">keys held right now, bit n is key n. core may not have them
+	/// yet while their events wait in the InputQueue</param>
+	/// <returns>true if the copy drew anything while running ahead</returns>
+	bool run(const Chip8& core, unsigned short keys);
+
+	/// <summary>
+	/// The machine as of the last run(). Use this for the screen
+	/// </summary>
+	const Chip8& getFuture() const { return future; }
+
+private:
+	int frames;
+	Chip8 future;
+	FusionTable fusion; //Outlives each copy, only the written parts get rescanned
+};
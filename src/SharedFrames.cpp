@@ -0,0 +1,271 @@
+#include "SharedFrames.h"
+#include <atomic>
+#include <new>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//The region is shared with other processes, atomics in it must not need a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "atomics must be lock free");
+
+namespace {
+	const int FRAME_WORDS = (sizeof(SharedFrame) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	/// <summary>
+	/// The name each platform wants: a leading slash for shm_open, a
+	/// session local name for Windows
+	/// </summary>
+	void systemName(const char* name, char* out, int outLen) {
+#ifdef _WIN32
+		snprintf(out, outLen, "Local\\%s", name);
+#else
+		snprintf(out, outLen, name[0] == '/' ? "%s" : "/%s", name);
+#endif
+	}
+}
+
+/// <summary>
+/// Layout of the shared memory. magic is written last, so a reader that
+/// sees it sees the rest of the header
+/// </summary>
+struct SharedFrameRegion {
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t frameBytes; //sizeof(SharedFrame)
+	std::atomic<uint32_t> closed;
+	std::atomic<uint32_t> generation; //Bumped by each run of the writer that takes over the region
+	alignas(64) std::atomic<uint64_t> head; //Newest sequence number
+
+	//seq is 0 while the writer fills the slot, else the sequence number of the frame in it
+	struct Slot {
+		alignas(64) std::atomic<uint64_t> seq;
+		std::atomic<uint64_t> words[FRAME_WORDS];
+	} slot[SHARED_FRAME_SLOTS];
+};
+
+SharedFrameWriter::SharedFrameWriter() : region(nullptr), handle(nullptr) {
+	name[0] = 0;
+}
+
+SharedFrameWriter::~SharedFrameWriter() {
+	close();
+}
+
+bool SharedFrameWriter::create(const char* name) {
+	close();
+	systemName(name, this->name, sizeof(this->name));
+
+	void* memory = nullptr;
+	bool existed = false;
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SharedFrameRegion), this->name);
+	if (!mapping) return false;
+	//a reader still holding the last run's mapping keeps it alive, and we get that one back
+	existed = GetLastError() == ERROR_ALREADY_EXISTS;
+	memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedFrameRegion));
+	if (!memory) {
+		CloseHandle(mapping);
+		return false;
+	}
+	handle = mapping;
+#else
+	//readers still mapping an old region keep it, they'll see it closed
+	shm_unlink(this->name);
+	int fd = shm_open(this->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) return false;
+	if (ftruncate(fd, sizeof(SharedFrameRegion)) == 0) {
+		memory = mmap(nullptr, sizeof(SharedFrameRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (memory == MAP_FAILED) memory = nullptr;
+	}
+	::close(fd);
+	if (!memory) {
+		shm_unlink(this->name);
+		return false;
+	}
+#endif
+
+	SharedFrameRegion* old = (SharedFrameRegion*)memory;
+	bool ours = old->magic.load(std::memory_order_acquire) == SHARED_FRAME_MAGIC
+		&& old->version == SHARED_FRAME_VERSION
+		&& old->slots == SHARED_FRAME_SLOTS
+		&& old->frameBytes == sizeof(SharedFrame);
+	if (existed && ours) {
+		//resetting it would pull the header out from under those readers, and
+		//restarting the sequence numbers would pass old frames off as new ones.
+		//Carry on from head and tell the readers it's a new run instead
+		region = old;
+		region->generation.fetch_add(1, std::memory_order_release);
+		region->closed.store(0, std::memory_order_release);
+		return true;
+	}
+
+	region = new (memory) SharedFrameRegion();
+	region->version = SHARED_FRAME_VERSION;
+	region->slots = SHARED_FRAME_SLOTS;
+	region->frameBytes = sizeof(SharedFrame);
+	region->closed.store(0, std::memory_order_relaxed);
+	region->generation.store(0, std::memory_order_relaxed);
+	region->head.store(0, std::memory_order_relaxed);
+	for (int s = 0; s < SHARED_FRAME_SLOTS; s++) {
+		region->slot[s].seq.store(0, std::memory_order_relaxed);
+	}
+	region->magic.store(SHARED_FRAME_MAGIC, std::memory_order_release);
+	return true;
+}
+
+void SharedFrameWriter::close() {
+	if (!region) return;
+	region->closed.store(1, std::memory_order_release);
+
+#ifdef _WIN32
+	UnmapViewOfFile(region);
+	CloseHandle((HANDLE)handle);
+	handle = nullptr;
+#else
+	munmap(region, sizeof(SharedFrameRegion));
+	shm_unlink(name);
+#endif
+	region = nullptr;
+}
+
+void SharedFrameWriter::publish(SharedFrame& frame) {
+	if (!region) return;
+	uint64_t seq = region->head.load(std::memory_order_relaxed) + 1;
+	frame.seq = seq;
+
+	uint64_t words[FRAME_WORDS] = {};
+	memcpy(words, &frame, sizeof(SharedFrame));
+
+	SharedFrameRegion::Slot& slot = region->slot[seq % SHARED_FRAME_SLOTS];
+	slot.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (int i = 0; i < FRAME_WORDS; i++) {
+		slot.words[i].store(words[i], std::memory_order_relaxed);
+	}
+
+	slot.seq.store(seq, std::memory_order_release);
+	region->head.store(seq, std::memory_order_release);
+}
+
+SharedFrameReader::SharedFrameReader() : region(nullptr), handle(nullptr), generation(0), device(0), inode(0) {
+	name[0] = 0;
+}
+
+SharedFrameReader::~SharedFrameReader() {
+	close();
+}
+
+bool SharedFrameReader::open(const char* name) {
+	close();
+	systemName(name, this->name, sizeof(this->name));
+
+	const void* memory = nullptr;
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, this->name);
+	if (!mapping) return false;
+	memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SharedFrameRegion));
+	if (!memory) {
+		CloseHandle(mapping);
+		return false;
+	}
+	handle = mapping;
+#else
+	int fd = shm_open(this->name, O_RDONLY, 0);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(SharedFrameRegion)) {
+		memory = mmap(nullptr, sizeof(SharedFrameRegion), PROT_READ, MAP_SHARED, fd, 0);
+		if (memory == MAP_FAILED) memory = nullptr;
+		device = (uint64_t)info.st_dev;
+		inode = (uint64_t)info.st_ino;
+	}
+	::close(fd);
+	if (!memory) return false;
+#endif
+
+	region = (const SharedFrameRegion*)memory;
+	bool valid = region->magic.load(std::memory_order_acquire) == SHARED_FRAME_MAGIC
+		&& region->version == SHARED_FRAME_VERSION
+		&& region->slots == SHARED_FRAME_SLOTS
+		&& region->frameBytes == sizeof(SharedFrame);
+	if (!valid) {
+		close();
+		return false;
+	}
+	generation = region->generation.load(std::memory_order_acquire);
+	return true;
+}
+
+void SharedFrameReader::close() {
+	if (!region) return;
+#ifdef _WIN32
+	UnmapViewOfFile(region);
+	CloseHandle((HANDLE)handle);
+	handle = nullptr;
+#else
+	munmap((void*)region, sizeof(SharedFrameRegion));
+#endif
+	region = nullptr;
+}
+
+bool SharedFrameReader::isClosed() const {
+	if (!region) return false;
+	if (region->closed.load(std::memory_order_acquire) != 0
+		|| region->generation.load(std::memory_order_acquire) != generation) {
+		return true;
+	}
+#ifdef _WIN32
+	return false;
+#else
+	//a writer that died never set closed. Its next run unlinks the name and
+	//makes a new region, which only shows as a different inode
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) return true;
+	struct stat info;
+	bool same = fstat(fd, &info) == 0 && (uint64_t)info.st_dev == device && (uint64_t)info.st_ino == inode;
+	::close(fd);
+	return !same;
+#endif
+}
+
+uint64_t SharedFrameReader::latest() const {
+	if (!region) return 0;
+	return region->head.load(std::memory_order_acquire);
+}
+
+bool SharedFrameReader::read(uint64_t seq, SharedFrame& out) const {
+	if (!region || seq == 0) return false;
+	const SharedFrameRegion::Slot& slot = region->slot[seq % SHARED_FRAME_SLOTS];
+	if (slot.seq.load(std::memory_order_acquire) != seq) return false;
+
+	uint64_t words[FRAME_WORDS];
+	for (int i = 0; i < FRAME_WORDS; i++) {
+		words[i] = slot.words[i].load(std::memory_order_relaxed);
+	}
+
+	//sequence numbers only grow, so the same one before and after means no write in between
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.seq.load(std::memory_order_relaxed) != seq) return false;
+
+	memcpy(&out, words, sizeof(SharedFrame));
+	return true;
+}
+
+bool SharedFrameReader::readLatest(SharedFrame& out) const {
+	for (;;) {
+		uint64_t seq = latest();
+		if (seq == 0) return false;
+		if (read(seq, out)) return true;
+		//the writer lapped the slot while we copied it, try the newer head
+	}
+}
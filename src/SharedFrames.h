@@ -0,0 +1,124 @@
+#pragma once
+#include <stdint.h>
+
+/// <summary>
+/// Frames published through shared memory
+/// ===================================================================================
+/// The emulator can publish every frame it finishes into a named shared
+/// memory region (shm_open on POSIX, a named file mapping on Windows):
+/// the packed screen, the registers and the frame counter. Other processes
+/// open the region read only and follow along without a socket or any
+/// emulator code. This header and SharedFrames.cpp are the whole reader
+/// library, see examples/FrameReader.cpp.
+///
+/// The region holds a ring of the last SHARED_FRAME_SLOTS frames. Every
+/// publish gets the next sequence number, starting at 1, and goes into
+/// slot seq % SHARED_FRAME_SLOTS. Each slot is a seqlock like StateView:
+/// its sequence is 0 while the writer fills it. A reader that overlaps a
+/// write, or asks for a frame that was already overwritten, just gets
+/// false. The writer never waits on readers, so a slow reader drops
+/// frames instead of holding the emulator up.
+///
+/// Everything in the region is fixed size, so a reader built with a
+/// different compiler sees the same layout.
+/// ===================================================================================
+/// </summary>
+
+#define SHARED_FRAME_MAGIC 0x42463843u //"C8FB"
+#define SHARED_FRAME_VERSION 1
+#define SHARED_FRAME_SLOTS 64
+//Region name when CHIP8_SHM_NAME isn't set
+#define SHARED_FRAME_NAME "chip8-frames"
+
+struct SharedFrameRegion;
+
+struct SharedFrame {
+	uint64_t seq; //Publish number, 1 for the first
+	uint64_t frame; //60hz frames since the machine was reset
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t i;
+	uint16_t sp;
+	uint16_t stack[16];
+	uint8_t v[16];
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t screen[32 * 8]; //Same packed layout as Chip8::getScreen
+};
+
+class SharedFrameWriter
+{
+public:
+	SharedFrameWriter();
+	~SharedFrameWriter();
+
+	/// <summary>
+	/// Create the region, replacing any left over from an earlier run. On
+	/// Windows a mapping a reader still holds can't be replaced, so it is
+	/// taken over and its readers see it as closed
+	/// </summary>
+	bool create(const char* name);
+	/// <summary>
+	/// Mark the region closed for readers and remove it
+	/// </summary>
+	void close();
+	bool isOpen() const { return region != nullptr; }
+
+	/// <summary>
+	/// Put a frame in the ring. frame.seq is filled in. Only one thread may publish
+	/// </summary>
+	void publish(SharedFrame& frame);
+
+private:
+	SharedFrameRegion* region;
+	void* handle; //Windows: the mapping. POSIX: unused
+	char name[64];
+};
+
+class SharedFrameReader
+{
+public:
+	SharedFrameReader();
+	~SharedFrameReader();
+
+	/// <returns>false if there is no region by that name or it isn't one of ours</returns>
+	bool open(const char* name);
+	void close();
+	bool isOpen() const { return region != nullptr; }
+
+	/// <summary>
+	/// True once the writer has closed the region, or a new run of the
+	/// emulator has taken it over. Open it again to follow the new run.
+	/// On POSIX a writer that died can't mark the region closed, so this
+	/// also checks the name still leads to the region we mapped, which
+	/// costs an shm_open. A writer that died with no new run to replace it
+	/// looks the same as one that stopped publishing
+	/// </summary>
+	bool isClosed() const;
+
+	/// <summary>
+	/// Sequence number of the newest frame, 0 if there isn't one yet
+	/// </summary>
+	uint64_t latest() const;
+
+	/// <summary>
+	/// Read one frame by sequence number. Frames older than
+	/// latest() - SHARED_FRAME_SLOTS + 1 have been overwritten
+	/// </summary>
+	/// <returns>false if the frame isn't in the ring, or was being overwritten</returns>
+	bool read(uint64_t seq, SharedFrame& out) const;
+
+	/// <summary>
+	/// Read the newest frame, retrying if the writer overtakes us
+	/// </summary>
+	/// <returns>false if nothing was published yet</returns>
+	bool readLatest(SharedFrame& out) const;
+
+private:
+	const SharedFrameRegion* region;
+	void* handle;
+	uint32_t generation; //The region's when it was opened
+	char name[64]; //POSIX: the name it was opened by, a new run puts a new region there
+	uint64_t device; //POSIX: which region that was
+	uint64_t inode;
+};
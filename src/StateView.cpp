@@ -0,0 +1,62 @@
+#include "StateView.h"
+#include "Chip8.h"
+#include <string.h>
+
+StateView::StateView() {
+	seq.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < WORDS; i++) {
+		data[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void StateView::publish(const Chip8& core) {
+	//build the snapshot privately first so the odd sequence window stays short
+	Snapshot s = {};
+	s.frame = core.frame;
+	s.pc = core.pc;
+	s.opcode = core.opcode;
+	s.I = core.I;
+	s.sp = core.sp;
+	s.delay_timer = core.delay_timer;
+	s.sound_timer = core.sound_timer;
+	memcpy(s.stack, core.stack, sizeof(s.stack));
+	memcpy(s.V, core.V, sizeof(s.V));
+	memcpy(s.graphic, core.graphic, sizeof(s.graphic));
+
+	unsigned long long words[WORDS] = {};
+	memcpy(words, &s, sizeof(Snapshot));
+
+	//odd sequence means a write is in progress
+	unsigned int start = seq.load(std::memory_order_relaxed);
+	seq.store(start + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (int i = 0; i < WORDS; i++) {
+		data[i].store(words[i], std::memory_order_relaxed);
+	}
+
+	seq.store(start + 2, std::memory_order_release);
+}
+
+bool StateView::tryRead(Snapshot& out) const {
+	unsigned int before = seq.load(std::memory_order_acquire);
+	if (before & 1) return false;
+
+	unsigned long long words[WORDS];
+	for (int i = 0; i < WORDS; i++) {
+		words[i] = data[i].load(std::memory_order_relaxed);
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	unsigned int after = seq.load(std::memory_order_relaxed);
+	if (before != after) return false;
+
+	memcpy(&out, words, sizeof(Snapshot));
+	return true;
+}
+
+void StateView::read(Snapshot& out) const {
+	while (!tryRead(out)) {
+		//writer is mid publish. it finishes in well under a microsecond
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+
+class Chip8;
+
+/// <summary>
+/// Seqlock published view of a Chip8 machine
+/// ===================================================================================
+/// The emulation thread calls publish() at frame boundaries. Any number of
+/// other threads can call read() at the same time to get a consistent copy of
+/// the registers, timers and screen.
+///
+/// Readers never write to shared memory, so they can't slow down the writer
+/// or each other. The writer never waits. A reader that overlaps a publish
+/// simply retries.
+/// ===================================================================================
+/// </summary>
+class StateView
+{
+public:
+	struct Snapshot {
+		unsigned long long frame;
+		unsigned short pc;
+		unsigned short opcode;
+		unsigned short I;
+		unsigned short sp;
+		unsigned short stack[16];
+		unsigned char V[16];
+		unsigned char delay_timer;
+		unsigned char sound_timer;
+		unsigned char graphic[32 * 8]; //Same packed layout as Chip8::getScreen
+	};
+
+	StateView();
+
+	/// <summary>
+	/// Copy the state of core into the view. Only one thread may publish
+	/// </summary>
+	void publish(const Chip8& core);
+
+	/// <summary>
+	/// Try once to read a consistent snapshot
+	/// </summary>
+	/// <returns>false if a publish was in progress. out is left untouched</returns>
+	bool tryRead(Snapshot& out) const;
+
+	/// <summary>
+	/// Read a consistent snapshot, retrying until we get one
+	/// </summary>
+	void read(Snapshot& out) const;
+
+	/// <summary>
+	/// Number of completed publishes. Readers can poll this to
+	/// see if there is anything new before copying
+	/// </summary>
+	unsigned int getVersion() const { return seq.load(std::memory_order_acquire) / 2; }
+
+private:
+	//Payload is kept as relaxed atomic words so concurrent reads are well defined
+	static const int WORDS = (sizeof(Snapshot) + sizeof(unsigned long long) - 1) / sizeof(unsigned long long);
+
+	alignas(64) std::atomic<unsigned int> seq;
+	alignas(64) std::atomic<unsigned long long> data[WORDS];
+};
@@ -0,0 +1,191 @@
+#include "Trace.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+
+std::atomic<bool> Trace::enabled(false);
+
+namespace {
+	/// <summary>
+	/// One event. seq is 0 while the owner writes it, else its index + 1,
+	/// the same seqlock as StateView but per slot
+	/// </summary>
+	struct Slot {
+		std::atomic<unsigned long long> seq;
+		std::atomic<const char*> name;
+		std::atomic<unsigned long long> start;
+		std::atomic<unsigned long long> end;
+	};
+
+	struct Ring {
+		int tid;
+		std::atomic<const char*> threadName;
+		std::atomic<unsigned long long> head; //Events ever recorded
+		Slot slots[Trace::RING_EVENTS];
+	};
+
+	//Rings live until exit so a dump never sees one go away. A thread that
+	//exits hands its ring to the next new thread, with its older events
+	std::mutex ringsLock;
+	std::vector<std::unique_ptr<Ring>> rings;
+	std::vector<Ring*> freeRings;
+
+	/// <summary>
+	/// Gives the thread's ring back when the thread exits
+	/// </summary>
+	struct RingOwner {
+		Ring* ring = nullptr;
+
+		~RingOwner() {
+			if (!ring) return;
+			std::lock_guard<std::mutex> guard(ringsLock);
+			freeRings.push_back(ring);
+		}
+	};
+
+	/// <summary>
+	/// The calling thread's ring. Only locks the first time a thread asks
+	/// </summary>
+	Ring& threadRing() {
+		thread_local RingOwner owner;
+		if (owner.ring) return *owner.ring;
+
+		std::lock_guard<std::mutex> guard(ringsLock);
+		if (!freeRings.empty()) {
+			//keeps its tid, head and events
+			owner.ring = freeRings.back();
+			freeRings.pop_back();
+			owner.ring->threadName.store(nullptr, std::memory_order_relaxed);
+			return *owner.ring;
+		}
+
+		rings.emplace_back(new Ring());
+		Ring* ring = rings.back().get();
+		ring->tid = (int)rings.size();
+		ring->threadName.store(nullptr, std::memory_order_relaxed);
+		ring->head.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < Trace::RING_EVENTS; i++) {
+			ring->slots[i].seq.store(0, std::memory_order_relaxed);
+		}
+		owner.ring = ring;
+		return *ring;
+	}
+
+	void appendString(std::string& out, const char* text) {
+		out += '"';
+		for (const char* c = text; *c; c++) {
+			if (*c == '"' || *c == '\\') out += '\\';
+			out += *c;
+		}
+		out += '"';
+	}
+}
+
+unsigned long long Trace::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, unsigned long long start, unsigned long long end) {
+	Ring& ring = threadRing();
+	unsigned long long n = ring.head.load(std::memory_order_relaxed);
+	Slot& slot = ring.slots[n % RING_EVENTS];
+
+	slot.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.start.store(start, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+
+	slot.seq.store(n + 1, std::memory_order_release);
+	ring.head.store(n + 1, std::memory_order_release);
+}
+
+void Trace::nameThread(const char* name) {
+	threadRing().threadName.store(name, std::memory_order_relaxed);
+}
+
+std::string Trace::dump() {
+	struct Event {
+		const char* name;
+		unsigned long long start;
+		unsigned long long end;
+		int tid;
+	};
+	std::vector<Event> events;
+	std::vector<std::pair<int, const char*>> names;
+
+	{
+		std::lock_guard<std::mutex> guard(ringsLock);
+		for (const std::unique_ptr<Ring>& ring : rings) {
+			const char* threadName = ring->threadName.load(std::memory_order_relaxed);
+			if (threadName) names.push_back(std::make_pair(ring->tid, threadName));
+
+			for (int i = 0; i < RING_EVENTS; i++) {
+				const Slot& slot = ring->slots[i];
+				unsigned long long before = slot.seq.load(std::memory_order_acquire);
+				if (before == 0) continue;
+
+				Event e;
+				e.name = slot.name.load(std::memory_order_relaxed);
+				e.start = slot.start.load(std::memory_order_relaxed);
+				e.end = slot.end.load(std::memory_order_relaxed);
+				e.tid = ring->tid;
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.seq.load(std::memory_order_relaxed) != before) continue;
+				events.push_back(e);
+			}
+		}
+	}
+
+	//timestamps relative to the oldest event, in microseconds
+	unsigned long long base = ~0ull;
+	for (const Event& e : events) {
+		if (e.start < base) base = e.start;
+	}
+
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	char text[96];
+	for (const std::pair<int, const char*>& name : names) {
+		if (!first) out += ",";
+		first = false;
+		snprintf(text, sizeof(text), "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", name.first);
+		out += text;
+		appendString(out, name.second);
+		out += "}}";
+	}
+	for (const Event& e : events) {
+		if (!first) out += ",";
+		first = false;
+		snprintf(text, sizeof(text), "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+			e.tid, (e.start - base) / 1000.0, (e.end - e.start) / 1000.0);
+		out += text;
+		appendString(out, e.name);
+		out += "}";
+	}
+	out += "]}\n";
+	return out;
+}
+
+bool Trace::dumpFile(const char* path) {
+	std::string text = dump();
+	std::ofstream fs(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	fs.write(text.data(), text.size());
+	fs.close();
+	return !fs.fail();
+}
+
+void Trace::clear() {
+	std::lock_guard<std::mutex> guard(ringsLock);
+	for (const std::unique_ptr<Ring>& ring : rings) {
+		for (int i = 0; i < RING_EVENTS; i++) {
+			//can race with the owner writing the slot, which then just keeps its event
+			ring->slots[i].seq.store(0, std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <string>
+
+/// <summary>
+/// Scoped trace events in the Chrome trace format
+/// ===================================================================================
+/// Put TRACE_SCOPE("name") at the top of a block to record how long the
+/// block took. Events go into a ring buffer owned by the recording thread,
+/// so threads never wait on each other or on dump(). dump() turns the most
+/// recent events of every thread into JSON that chrome://tracing and
+/// Perfetto open directly.
+///
+/// While tracing is off a scope is one relaxed load and a branch. Define
+/// CHIP8_NO_TRACE to compile the scopes out entirely.
+///
+/// Names must be string literals, only the pointer is stored.
+/// ===================================================================================
+/// </summary>
+class Trace
+{
+public:
+	//Events kept per thread. Older ones are overwritten
+	static const int RING_EVENTS = 16384;
+
+	static void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	/// <summary>
+	/// Name the calling thread in dumps
+	/// </summary>
+	static void nameThread(const char* name);
+
+	/// <summary>
+	/// Every thread's kept events as Chrome trace JSON. Safe to call while
+	/// other threads record, events being written at that moment are left out
+	/// </summary>
+	static std::string dump();
+	static bool dumpFile(const char* path);
+
+	/// <summary>
+	/// Drop every kept event
+	/// </summary>
+	static void clear();
+
+	class Scope
+	{
+	public:
+		Scope(const char* name) : name(isEnabled() ? name : nullptr) {
+			if (this->name) start = now();
+		}
+		~Scope() {
+			if (name) record(name, start, now());
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* name; //null if tracing was off when the scope started
+		unsigned long long start;
+	};
+
+private:
+	static std::atomic<bool> enabled;
+
+	/// <returns>host time in nanoseconds</returns>
+	static unsigned long long now();
+	static void record(const char* name, unsigned long long start, unsigned long long end);
+};
+
+#ifdef CHIP8_NO_TRACE
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
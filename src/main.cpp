@@ -1,9 +1,23 @@
 #include "Chip8.h"
+#include "Debugger.h"
+#include "StateView.h"
+#include "InputQueue.h"
+#include "LatencyStats.h"
+#include "RunAhead.h"
+#include "Netplay.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "GridView.h"
+#include "Explorer.h"
+#include "SharedFrames.h"
+#include "CoreTests.h"
 
 #include <iostream>
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <random>
+#include <vector>
 
 #include <SDL.h>
 
@@ -16,10 +30,22 @@
 #include <nfd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define WINDOW_RES_X 640
 #define WINDOW_RES_Y 480
 
+//Longest stall we try to catch up on
+#define MAX_CATCH_UP_MS 100
+//Longest we sleep when there's nothing to emulate
+#define IDLE_WAIT_MS 250
+//Frames to keep presenting after UI input so ImGui can settle
+#define UI_SETTLE_FRAMES 3
+//How often the metrics file is rewritten
+#define METRICS_INTERVAL_MS 1000
+//Metrics file when CHIP8_METRICS_FILE isn't set
+#define METRICS_FILE "chip-8.prom"
+
 SDL_Window* window = NULL;
 SDL_GLContext gl_context = NULL;
 
@@ -29,6 +55,194 @@ const int gl_minor_ver = 0;
 
 Chip8 core;
 bool rom_loaded = false;
+std::vector<char> rom; //The loaded ROM, for starting fresh machines
+
+Debugger debugger;
+bool debugger_open = false;
+
+//Published at every frame boundary. UI code reads from here instead of
+//poking at the core, so it does not care which thread runs the emulation
+StateView stateView;
+StateView::Snapshot snapshot;
+
+InputQueue inputQueue;
+LatencyStats latencyStats;
+bool latency_open = false;
+
+//Present only when something changed and sleep until the next
+//emulated frame, instead of spinning a host core
+bool power_saving = true;
+
+RunAhead runAhead;
+bool beeping = false;
+
+//Timing model and speed, as a multiple of the real machine
+bool vip_timing = false;
+double speed = 1;
+
+//Rollback netplay. While a session runs it owns its own machine and
+//core is only used as the starting point
+NetSession netSession;
+UdpTransport netTransport;
+bool netplay_open = false;
+unsigned short local_keys = 0; //bit n set while key n is held
+double netplay_debt = 0; //60hz frames we still owe the session
+
+//Fleet monitoring. Written to a Prometheus textfile every METRICS_INTERVAL_MS
+Metrics metrics;
+struct MetricIds {
+	int instructions;
+	int keyWaitCycles;
+	int emulatedFrames;
+	int framesPresented;
+	int framesDropped;
+	int drawCalls;
+	int textureUploadBytes;
+	int beeps;
+	int instructionsPerSecond;
+	int cyclesPerFrame;
+	int keyWaitFraction;
+	int drawCallsPerFrame;
+	int hostFrameMs;
+} metric;
+bool metrics_open = false;
+
+//Many copies of the loaded ROM side by side
+GridView gridView;
+bool grid_open = false;
+double grid_debt = 0; //60hz frames we still owe the grid
+
+//Input space search over the loaded ROM, on a thread of its own
+std::unique_ptr<Explorer> explorer;
+std::thread explore_thread;
+std::atomic<bool> exploring(false);
+bool explorer_open = false;
+//What the explorer finds the input to, added to every search on Start
+struct ExplorerTarget {
+	enum class Kind {
+		Pc, //An instruction at address runs
+		Register, //reg holds value
+		Memory //The byte at address holds value
+	} kind;
+	Debugger::Register reg;
+	unsigned short address;
+	unsigned short value;
+};
+std::vector<ExplorerTarget> explorer_targets;
+//The targets the last search started with, in the order results are shown
+std::vector<ExplorerTarget> explored_targets;
+
+//Checks of the alternate interpreters against the plain one
+bool core_tests_open = false;
+
+//Frames published to shared memory for other processes
+SharedFrameWriter sharedFrames;
+bool share_frames = false;
+
+/// <summary>
+/// High resolution host clock
+/// </summary>
+/// <returns>time in milliseconds</returns>
+double host_ms()
+{
+	return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/// <summary>
+/// Emulated time (see Chip8::getTime) to run per host second
+/// </summary>
+double time_per_second()
+{
+	return core.getTimePerFrame() * 60.0 * speed;
+}
+
+/// <summary>
+/// The loaded ROM on a machine that hasn't run anything yet
+/// </summary>
+Chip8 fresh_machine()
+{
+	Chip8 machine;
+	machine.initialize();
+	machine.setTiming(vip_timing ? Chip8::Timing::Vip : Chip8::Timing::Flat);
+	machine.loadProgram(rom.data(), (int)rom.size());
+	return machine;
+}
+
+/// <summary>
+/// Create the shared frame region, named by CHIP8_SHM_NAME if it's set
+/// </summary>
+bool open_shared_frames()
+{
+	const char* name = SDL_getenv("CHIP8_SHM_NAME");
+	return sharedFrames.create(name ? name : SHARED_FRAME_NAME);
+}
+
+/// <summary>
+/// Publish the state of a machine at a frame boundary, next to stateView
+/// </summary>
+void share_frame(const Chip8& machine)
+{
+	if (!sharedFrames.isOpen()) return;
+	Chip8::DebugInfo info = machine.dumpDebug();
+	SharedFrame frame = {};
+	frame.frame = machine.getFrame();
+	frame.pc = info.pc;
+	frame.opcode = info.opcode;
+	frame.i = info.i;
+	frame.sp = info.sp;
+	for (int i = 0; i < 16; i++) {
+		frame.stack[i] = info.stack[i];
+		frame.v[i] = info.V[i];
+	}
+	frame.delay_timer = (uint8_t)info.timer_delay;
+	frame.sound_timer = (uint8_t)info.timer_sound;
+	memcpy(frame.screen, machine.getScreen(), sizeof(frame.screen));
+	sharedFrames.publish(frame);
+}
+
+/// <summary>
+/// Map a keyboard key to the Chip-8 keypad. See README for the layout
+/// </summary>
+/// <returns>the Chip-8 key, or -1 if the key isn't mapped</returns>
+int map_key(SDL_Keycode sym)
+{
+	switch (sym)
+	{
+	case SDLK_1:
+		return 0x1;
+	case SDLK_2:
+		return 0x2;
+	case SDLK_3:
+		return 0x3;
+	case SDLK_4:
+		return 0xc;
+	case SDLK_q:
+		return 0x4;
+	case SDLK_w:
+		return 0x5;
+	case SDLK_e:
+		return 0x6;
+	case SDLK_r:
+		return 0xd;
+	case SDLK_a:
+		return 0x7;
+	case SDLK_s:
+		return 0x8;
+	case SDLK_d:
+		return 0x9;
+	case SDLK_f:
+		return 0xe;
+	case SDLK_z:
+		return 0xa;
+	case SDLK_x:
+		return 0x0;
+	case SDLK_c:
+		return 0xb;
+	case SDLK_v:
+		return 0xf;
+	}
+	return -1;
+}
 
 bool init() 
 {
@@ -52,8 +266,8 @@ bool init()
 	gl_context = SDL_GL_CreateContext(window);
 	SDL_GL_MakeCurrent(window, gl_context);
 
-	//Disable vsync because this makes emulation slow
-	SDL_GL_SetSwapInterval(0);
+	//Emulation is paced by the host clock, so vsync only limits how often we present
+	SDL_GL_SetSwapInterval(power_saving ? 1 : 0);
 
 	if (gl3wInit() != 0)
 	{
@@ -73,6 +287,59 @@ void init_imgui()
 	ImGui_ImplOpenGL3_Init(GLSL_VER);
 }
 
+void init_metrics()
+{
+	metric.instructions = metrics.addCounter("chip8_instructions_total", "Instructions run by the core");
+	metric.keyWaitCycles = metrics.addCounter("chip8_key_wait_cycles_total", "Instructions spent blocked on FX0A");
+	metric.emulatedFrames = metrics.addCounter("chip8_emulated_frames_total", "60hz frames emulated");
+	metric.framesPresented = metrics.addCounter("chip8_frames_presented_total", "Frames presented to the window");
+	metric.framesDropped = metrics.addCounter("chip8_frames_dropped_total", "Emulated frames that drew but were replaced before being presented");
+	metric.drawCalls = metrics.addCounter("chip8_draw_calls_total", "GPU draw calls issued");
+	metric.textureUploadBytes = metrics.addCounter("chip8_texture_upload_bytes_total", "Bytes uploaded to the screen texture");
+	metric.beeps = metrics.addCounter("chip8_beeps_total", "Times the sound timer started");
+	metric.instructionsPerSecond = metrics.addGauge("chip8_instructions_per_second", "Instructions per host second over the last interval");
+	metric.cyclesPerFrame = metrics.addGauge("chip8_cycles_per_frame", "Instructions per emulated frame over the last interval");
+	metric.keyWaitFraction = metrics.addGauge("chip8_key_wait_idle_fraction", "Fraction of instructions over the last interval spent blocked on FX0A");
+	metric.drawCallsPerFrame = metrics.addGauge("chip8_draw_calls_per_frame", "Draw calls per presented frame over the last interval");
+	metric.hostFrameMs = metrics.addSummary("chip8_host_frame_ms", "Host milliseconds from the start of a main loop iteration to its present");
+}
+
+/// <summary>
+/// Turn counter deltas into the per interval gauges and write the
+/// metrics file, once every METRICS_INTERVAL_MS
+/// </summary>
+void update_metrics(double now_ms)
+{
+	static double last_ms = now_ms;
+	static double last[4] = {};
+	if (now_ms - last_ms < METRICS_INTERVAL_MS) return;
+
+	double current[4] = {
+		metrics.get(metric.instructions),
+		metrics.get(metric.keyWaitCycles),
+		metrics.get(metric.emulatedFrames),
+		metrics.get(metric.drawCalls)
+	};
+	double instructions = current[0] - last[0];
+	double keyWait = current[1] - last[1];
+	double frames = current[2] - last[2];
+	double drawCalls = current[3] - last[3];
+	double presented = metrics.get(metric.framesPresented);
+	static double lastPresented = 0;
+
+	metrics.set(metric.instructionsPerSecond, instructions * 1000 / (now_ms - last_ms));
+	metrics.set(metric.cyclesPerFrame, frames > 0 ? instructions / frames : 0);
+	metrics.set(metric.keyWaitFraction, instructions > 0 ? keyWait / instructions : 0);
+	metrics.set(metric.drawCallsPerFrame, presented > lastPresented ? drawCalls / (presented - lastPresented) : 0);
+
+	for (int i = 0; i < 4; i++) last[i] = current[i];
+	lastPresented = presented;
+	last_ms = now_ms;
+
+	const char* path = SDL_getenv("CHIP8_METRICS_FILE");
+	metrics.writeFile(path ? path : METRICS_FILE);
+}
+
 void draw_imgui() 
 {
 	if (ImGui::BeginMainMenuBar()) {
@@ -82,7 +349,9 @@ void draw_imgui()
 				nfdresult_t result = NFD_OpenDialog(NULL, NULL, &path);
 
 				if (result == NFD_OKAY) {
+					TRACE_SCOPE("Load ROM");
 					core.initialize();
+					core.setTiming(vip_timing ? Chip8::Timing::Vip : Chip8::Timing::Flat);
 
 					std::fstream fs;
 					fs.open(path, std::fstream::in | std::fstream::binary);
@@ -91,22 +360,620 @@ void draw_imgui()
 					int len = fs.tellg();
 					fs.seekg(0, fs.beg);
 
-					char* romData = new char[len];
-					fs.read(romData, len);
+					rom.resize(len);
+					fs.read(rom.data(), len);
 
-					core.loadProgram(romData, len);
+					core.loadProgram(rom.data(), len);
 					rom_loaded = true;
+					stateView.publish(core);
+					share_frame(core);
+					inputQueue.clear();
+					latencyStats.reset();
 
-					delete[] romData;
 					fs.close();
 				}
 			}
 			ImGui::EndMenu();
-		}		
+		}
+		if (ImGui::BeginMenu("Options")) {
+			if (ImGui::MenuItem("Power Saving", NULL, &power_saving)) {
+				SDL_GL_SetSwapInterval(power_saving ? 1 : 0);
+			}
+			if (ImGui::BeginMenu("Run-Ahead")) {
+				char label[16];
+				for (int i = 0; i <= RunAhead::MAX_FRAMES; i++) {
+					if (i == 0) snprintf(label, sizeof(label), "Off");
+					else snprintf(label, sizeof(label), "%d frame%s", i, i > 1 ? "s" : "");
+					if (ImGui::MenuItem(label, NULL, runAhead.getFrames() == i)) runAhead.setFrames(i);
+				}
+				ImGui::EndMenu();
+			}
+			if (ImGui::MenuItem("Share Frames", NULL, &share_frames)) {
+				if (share_frames) share_frames = open_shared_frames();
+				else sharedFrames.close();
+			}
+			if (ImGui::BeginMenu("Timing")) {
+				bool changed = false;
+				if (ImGui::MenuItem("Flat (8 per frame)", NULL, !vip_timing)) {
+					changed = vip_timing;
+					vip_timing = false;
+				}
+				if (ImGui::MenuItem("COSMAC VIP", NULL, vip_timing)) {
+					changed = !vip_timing;
+					vip_timing = true;
+				}
+				if (changed) {
+					core.setTiming(vip_timing ? Chip8::Timing::Vip : Chip8::Timing::Flat);
+					//queued events are stamped in the old time units
+					inputQueue.flush(core);
+				}
+				ImGui::EndMenu();
+			}
+			if (ImGui::BeginMenu("Speed")) {
+				static const double speeds[] = { 0.5, 1, 2, 4, 8 };
+				char label[16];
+				for (double s : speeds) {
+					snprintf(label, sizeof(label), "%gx", s);
+					if (ImGui::MenuItem(label, NULL, speed == s)) speed = s;
+				}
+				ImGui::EndMenu();
+			}
+			ImGui::EndMenu();
+		}
+		if (ImGui::BeginMenu("Debug")) {
+			ImGui::MenuItem("Debugger", NULL, &debugger_open);
+			ImGui::MenuItem("Input Latency", NULL, &latency_open);
+			ImGui::MenuItem("Metrics", NULL, &metrics_open);
+			ImGui::MenuItem("Explorer", NULL, &explorer_open);
+			ImGui::MenuItem("Core Tests", NULL, &core_tests_open);
+			ImGui::Separator();
+			bool tracing = Trace::isEnabled();
+			if (ImGui::MenuItem("Record Trace", NULL, &tracing)) {
+				if (tracing) Trace::clear();
+				Trace::setEnabled(tracing);
+			}
+			if (ImGui::MenuItem("Save Trace")) {
+				nfdchar_t* path = NULL;
+				if (NFD_SaveDialog("json", NULL, &path) == NFD_OKAY) {
+					Trace::dumpFile(path);
+					free(path);
+				}
+			}
+			ImGui::EndMenu();
+		}
+		if (ImGui::BeginMenu("View")) {
+			ImGui::MenuItem("Grid", NULL, &grid_open);
+			ImGui::EndMenu();
+		}
+		if (ImGui::BeginMenu("Netplay")) {
+			ImGui::MenuItem("Netplay", NULL, &netplay_open);
+			ImGui::EndMenu();
+		}
 		ImGui::EndMainMenuBar();
 	}	
 }
 
+void draw_debugger()
+{
+	if (!debugger_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(0, 330), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(530, 440), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Debugger", &debugger_open)) {
+		ImGui::End();
+		return;
+	}
+
+	stateView.read(snapshot);
+
+	//execution control
+	if (debugger.isPaused()) {
+		if (ImGui::Button("Continue")) debugger.resume();
+	}
+	else {
+		if (ImGui::Button("Pause")) debugger.pause();
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Step Into")) debugger.stepInto();
+	ImGui::SameLine();
+	if (ImGui::Button("Step Over")) debugger.stepOver(core);
+	ImGui::SameLine();
+	if (ImGui::Button("Step Out")) debugger.stepOut(core);
+
+	static const char* reasons[] = { "Running", "Paused", "Breakpoint", "Watchpoint", "Condition", "Step" };
+	ImGui::SameLine();
+	ImGui::Text(debugger.isPaused() ? "[%s]" : "%s", reasons[(int)debugger.getBreakReason()]);
+
+	ImGui::Separator();
+
+	//registers
+	for (int i = 0; i < 16; i++) {
+		if (i % 8 != 0) ImGui::SameLine();
+		ImGui::Text("V%X:%02X", i, snapshot.V[i]);
+	}
+	ImGui::Text("PC:%03X  I:%03X  SP:%X  DT:%02X  ST:%02X", snapshot.pc, snapshot.I, snapshot.sp, snapshot.delay_timer, snapshot.sound_timer);
+	ImGui::Text("Frame: %llu", snapshot.frame);
+
+	ImGui::Separator();
+
+	//disassembly around pc. click a line to toggle a breakpoint
+	ImGui::BeginChild("Disassembly", ImVec2(260, 220), true);
+	char text[32];
+	char line[64];
+	unsigned short start = snapshot.pc >= 0x10 ? snapshot.pc - 0x10 : 0;
+	for (unsigned short addr = start; addr < start + 0x40 && addr < 0xfff; addr += 2) {
+		unsigned short op = Debugger::readOpcode(core, addr);
+		Debugger::disassemble(op, text, sizeof(text));
+		snprintf(line, sizeof(line), "%c%c %03X  %04X  %s",
+			debugger.hasBreakpoint(addr) ? '*' : ' ',
+			addr == snapshot.pc ? '>' : ' ',
+			addr, op, text);
+		ImGui::PushID(addr);
+		if (ImGui::Selectable(line, addr == snapshot.pc)) {
+			debugger.toggleBreakpoint(addr);
+		}
+		ImGui::PopID();
+	}
+	ImGui::EndChild();
+
+	//call stack, innermost frame first
+	ImGui::SameLine();
+	ImGui::BeginChild("Call Stack", ImVec2(0, 220), true);
+	ImGui::Text("Call stack");
+	ImGui::Text("#0 %03X", snapshot.pc);
+	for (int i = snapshot.sp - 1; i >= 0; i--) {
+		ImGui::Text("#%d %03X", snapshot.sp - i, snapshot.stack[i]);
+	}
+	ImGui::EndChild();
+
+	ImGui::Separator();
+
+	//breakpoints
+	static unsigned short bpAddr = 0x200;
+	ImGui::SetNextItemWidth(60);
+	ImGui::InputScalar("##bp", ImGuiDataType_U16, &bpAddr, NULL, NULL, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SameLine();
+	if (ImGui::Button("Toggle Breakpoint")) debugger.toggleBreakpoint(bpAddr);
+
+	//watchpoints
+	static unsigned short wpAddr = 0x200;
+	static unsigned short wpLen = 1;
+	static int wpType = 2;
+	static const char* wpTypes[] = { "Read", "Write", "Read/Write" };
+	ImGui::SetNextItemWidth(60);
+	ImGui::InputScalar("##wpaddr", ImGuiDataType_U16, &wpAddr, NULL, NULL, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(40);
+	ImGui::InputScalar("##wplen", ImGuiDataType_U16, &wpLen, NULL, NULL, "%u");
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(100);
+	ImGui::Combo("##wptype", &wpType, wpTypes, 3);
+	ImGui::SameLine();
+	if (ImGui::Button("Add Watchpoint")) debugger.addWatchpoint(wpAddr, wpLen, (Debugger::WatchType)(wpType + 1));
+
+	const std::vector<Debugger::Watchpoint>& watchpoints = debugger.getWatchpoints();
+	for (int i = 0; i < (int)watchpoints.size(); i++) {
+		ImGui::PushID(i);
+		if (ImGui::SmallButton("x")) debugger.removeWatchpoint(i);
+		ImGui::SameLine();
+		ImGui::Text("watch %03X+%u %s", watchpoints[i].address, watchpoints[i].length, wpTypes[(int)watchpoints[i].type - 1]);
+		ImGui::PopID();
+	}
+
+	//register conditions
+	static int condReg = 0;
+	static int condCmp = 0;
+	static unsigned short condValue = 0;
+	static const char* cmpNames[] = { "==", "!=", "<", ">" };
+	ImGui::SetNextItemWidth(60);
+	ImGui::Combo("##condreg", &condReg, [](void*, int idx, const char** out) {
+		*out = Debugger::registerName((Debugger::Register)idx);
+		return true;
+	}, NULL, (int)Debugger::Register::SP + 1);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(50);
+	ImGui::Combo("##condcmp", &condCmp, cmpNames, 4);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(60);
+	ImGui::InputScalar("##condval", ImGuiDataType_U16, &condValue, NULL, NULL, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SameLine();
+	if (ImGui::Button("Add Condition")) debugger.addCondition((Debugger::Register)condReg, (Debugger::Compare)condCmp, condValue);
+
+	const std::vector<Debugger::Condition>& conditions = debugger.getConditions();
+	for (int i = 0; i < (int)conditions.size(); i++) {
+		ImGui::PushID(1000 + i);
+		if (ImGui::SmallButton("x")) debugger.removeCondition(i);
+		ImGui::SameLine();
+		ImGui::Text("break if %s %s %03X", Debugger::registerName(conditions[i].reg), cmpNames[(int)conditions[i].cmp], conditions[i].value);
+		ImGui::PopID();
+	}
+
+	ImGui::End();
+}
+
+void draw_latency()
+{
+	if (!latency_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(535, 25), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Input Latency", &latency_open, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("Key event to presented frame");
+	ImGui::Text("Samples: %d", latencyStats.getCount());
+	ImGui::Text("p50: %6.2f ms", latencyStats.percentile(50));
+	ImGui::Text("p90: %6.2f ms", latencyStats.percentile(90));
+	ImGui::Text("p99: %6.2f ms", latencyStats.percentile(99));
+	ImGui::Text("max: %6.2f ms", latencyStats.percentile(100));
+
+	static float samples[LatencyStats::MAX_SAMPLES];
+	int n = latencyStats.getSamples(samples, LatencyStats::MAX_SAMPLES);
+	ImGui::PlotLines("##latency", samples, n, 0, NULL, 0, 3.4e38f, ImVec2(250, 60));
+
+	if (ImGui::Button("Reset")) latencyStats.reset();
+
+	ImGui::End();
+}
+
+void draw_metrics()
+{
+	if (!metrics_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(535, 380), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Metrics", &metrics_open, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	for (int id = 0; id < metrics.getCount(); id++) {
+		if (metrics.getType(id) == Metrics::Type::Summary) {
+			ImGui::Text("%s p50 %.2f p90 %.2f p99 %.2f", metrics.getName(id),
+				metrics.percentile(id, 50), metrics.percentile(id, 90), metrics.percentile(id, 99));
+		}
+		else {
+			ImGui::Text("%s %.6g", metrics.getName(id), metrics.get(id));
+		}
+	}
+
+	ImGui::End();
+}
+
+/// <summary>
+/// Sleep until the core finishes its next emulated frame, or until
+/// SDL has an event for us. Whichever comes first
+/// </summary>
+/// <param name="loop_ms">host time the current loop iteration started at</param>
+/// <param name="cycle_debt">emulated time we still owe the core</param>
+void wait_for_next_event(double loop_ms, double cycle_debt)
+{
+	TRACE_SCOPE("Wait");
+	double wait_ms = IDLE_WAIT_MS;
+
+	if (netSession.isRunning()) {
+		wait_ms = (1 - netplay_debt) * 1000.0 / 60;
+	}
+	else if (rom_loaded && !(debugger_open && debugger.isPaused())) {
+		double time = core.getTimePerFrame() - (core.getTime() % core.getTimePerFrame()) - cycle_debt;
+		wait_ms = time * 1000.0 / time_per_second();
+	}
+	if (gridView.isRunning()) {
+		double grid_ms = (1 - grid_debt) * 1000.0 / (60 * speed);
+		if (grid_ms < wait_ms) wait_ms = grid_ms;
+	}
+	wait_ms -= host_ms() - loop_ms;
+
+	if (wait_ms >= 1) {
+		//passing NULL leaves the event in the queue for the main loop
+		SDL_WaitEventTimeout(NULL, (int)wait_ms);
+	}
+	else if (wait_ms > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait_ms * 1000)));
+	}
+}
+
+void draw_netplay()
+{
+	if (!netplay_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(535, 200), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Netplay", &netplay_open, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	static int localPort = 7700;
+	static char remoteHost[64] = "127.0.0.1";
+	static int remotePort = 7701;
+
+	if (!netSession.isRunning()) {
+		ImGui::Text("Both players must load the same ROM and timing before starting");
+		ImGui::InputInt("Local port", &localPort);
+		ImGui::InputText("Remote host", remoteHost, sizeof(remoteHost));
+		ImGui::InputInt("Remote port", &remotePort);
+
+		if (ImGui::Button("Start") && rom_loaded) {
+			if (netTransport.open((unsigned short)localPort, remoteHost, (unsigned short)remotePort)) {
+				//core has run for as long as this host had the ROM loaded, the peer's for
+				//a different while. both start over, the handshake checks they match
+				std::random_device random;
+				netSession.start(netTransport, fresh_machine(), random());
+				netplay_debt = 0;
+			}
+		}
+	}
+	else {
+		const NetSession::Stats& stats = netSession.getStats();
+		if (netSession.getState() == NetSession::State::Connecting)
+			ImGui::Text("Waiting for the other player");
+		else if (netSession.getState() == NetSession::State::Mismatch)
+			ImGui::Text("The other player has a different ROM or timing");
+		ImGui::Text("Frame: %u  confirmed: %u", netSession.getFrame(), netSession.getConfirmedFrame());
+		ImGui::Text("Rollbacks: %u  rerun: %u  deepest: %u", stats.rollbacks, stats.resimulatedFrames, stats.maxRollback);
+		ImGui::Text("Stalls: %u  sent: %u  received: %u", stats.stalls, stats.packetsSent, stats.packetsReceived);
+
+		if (ImGui::Button("Stop")) {
+			netSession.stop();
+			netTransport.close();
+		}
+	}
+
+	ImGui::Separator();
+
+	//run two sessions against each other in memory and check they stay in sync
+	static int testFrames = 3600;
+	static int testLatency = 4;
+	static int testJitter = 2;
+	static int testLoss = 10;
+	static std::string testReport;
+	ImGui::Text("Loopback test");
+	ImGui::SliderInt("Frames", &testFrames, 60, 36000);
+	ImGui::SliderInt("Latency (frames)", &testLatency, 0, 30);
+	ImGui::SliderInt("Jitter (frames)", &testJitter, 0, 10);
+	ImGui::SliderInt("Loss %", &testLoss, 0, 90);
+	if (ImGui::Button("Run Test") && rom_loaded) {
+		runLoopbackTest(fresh_machine(), testFrames, testLatency, testJitter, testLoss, testReport);
+	}
+	if (!testReport.empty()) ImGui::TextUnformatted(testReport.c_str());
+
+	ImGui::End();
+}
+
+void draw_grid()
+{
+	if (!grid_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(0, 330), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(700, 400), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Grid", &grid_open, ImGuiWindowFlags_HorizontalScrollbar)) {
+		ImGui::End();
+		return;
+	}
+
+	static int count = 16;
+	static int scale = 2;
+	ImGui::SetNextItemWidth(150);
+	ImGui::SliderInt("Instances", &count, 1, GridView::MAX_INSTANCES);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(100);
+	ImGui::SliderInt("Scale", &scale, 1, 4);
+	ImGui::SameLine();
+	if (ImGui::Button(gridView.isRunning() ? "Restart" : "Start") && rom_loaded) {
+		//copies of the loaded ROM as it is right now
+		gridView.start(core, count);
+		grid_debt = 0;
+	}
+	if (gridView.isRunning()) {
+		ImGui::SameLine();
+		if (ImGui::Button("Stop")) gridView.stop();
+	}
+
+	gridView.draw((float)scale);
+
+	ImGui::End();
+}
+
+void format_explorer_target(const ExplorerTarget& t, char* out, int outLen)
+{
+	switch (t.kind) {
+	case ExplorerTarget::Kind::Pc:
+		snprintf(out, outLen, "pc %03X", t.address);
+		break;
+	case ExplorerTarget::Kind::Register:
+		snprintf(out, outLen, "%s == %03X", Debugger::registerName(t.reg), t.value);
+		break;
+	default:
+		snprintf(out, outLen, "[%03X] == %02X", t.address, t.value);
+		break;
+	}
+}
+
+void draw_explorer_targets()
+{
+	static int kind = 0;
+	static int reg = 0;
+	static unsigned short address = 0x200;
+	static unsigned short value = 0;
+	static const char* kinds[] = { "PC reaches", "Register ==", "Memory ==" };
+
+	ImGui::SetNextItemWidth(110);
+	ImGui::Combo("##targetkind", &kind, kinds, 3);
+	ImGui::SameLine();
+	if (kind == (int)ExplorerTarget::Kind::Register) {
+		ImGui::SetNextItemWidth(60);
+		ImGui::Combo("##targetreg", &reg, [](void*, int idx, const char** out) {
+			*out = Debugger::registerName((Debugger::Register)idx);
+			return true;
+		}, NULL, (int)Debugger::Register::SP + 1);
+	}
+	else {
+		ImGui::SetNextItemWidth(60);
+		ImGui::InputScalar("##targetaddr", ImGuiDataType_U16, &address, NULL, NULL, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+		address &= 0x0fff;
+	}
+	if (kind != (int)ExplorerTarget::Kind::Pc) {
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(60);
+		ImGui::InputScalar("##targetval", ImGuiDataType_U16, &value, NULL, NULL, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Add Target")) {
+		ExplorerTarget t;
+		t.kind = (ExplorerTarget::Kind)kind;
+		t.reg = (Debugger::Register)reg;
+		t.address = address;
+		t.value = value;
+		explorer_targets.push_back(t);
+	}
+
+	char name[32];
+	for (int i = 0; i < (int)explorer_targets.size(); i++) {
+		ImGui::PushID(i);
+		if (ImGui::SmallButton("x")) {
+			explorer_targets.erase(explorer_targets.begin() + i);
+			ImGui::PopID();
+			break;
+		}
+		ImGui::SameLine();
+		format_explorer_target(explorer_targets[i], name, sizeof(name));
+		ImGui::Text("find %s", name);
+		ImGui::PopID();
+	}
+}
+
+void draw_explorer()
+{
+	if (!explorer_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(535, 30), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Explorer", &explorer_open, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	static int frames = 600;
+	static int maxStates = 1 << 20;
+	static int order = 0;
+	static const char* orders[] = { "Breadth first", "Best first" };
+
+	if (!exploring) {
+		ImGui::InputInt("Frames", &frames);
+		ImGui::InputInt("Max states", &maxStates);
+		if (frames < 0) frames = 0;
+		if (maxStates < 1) maxStates = 1;
+		if (maxStates > Explorer::MAX_STATES) maxStates = Explorer::MAX_STATES;
+		ImGui::Combo("Order", &order, orders, 2);
+
+		draw_explorer_targets();
+
+		if (ImGui::Button("Start") && rom_loaded) {
+			if (explore_thread.joinable()) explore_thread.join();
+			//search from the loaded ROM as it is right now
+			explorer.reset(new Explorer(core));
+			explored_targets = explorer_targets;
+			for (const ExplorerTarget& t : explored_targets) {
+				//targets only see the machine between frames, an address is found
+				//from the coverage instead, see getInputsTo
+				if (t.kind == ExplorerTarget::Kind::Pc) continue;
+				char name[32];
+				format_explorer_target(t, name, sizeof(name));
+				explorer->addTarget(name, [t](const Chip8& state) {
+					if (t.kind == ExplorerTarget::Kind::Register) return Debugger::readRegister(state, t.reg) == t.value;
+					return Debugger::readByte(state, t.address) == t.value;
+				});
+			}
+			Explorer::Settings settings;
+			settings.maxFrames = frames;
+			settings.maxStates = maxStates;
+			settings.order = order == 0 ? Explorer::Order::BreadthFirst : Explorer::Order::BestFirst;
+			exploring = true;
+			explore_thread = std::thread([settings]() {
+				Trace::nameThread("explorer");
+				explorer->run(settings);
+				exploring = false;
+			});
+		}
+	}
+	else {
+		ImGui::Text("States: %llu  depth: %d  covered: %d", explorer->getStates(), explorer->getDepth(), explorer->getCovered());
+		if (ImGui::Button("Stop")) explorer->stop();
+	}
+
+	if (!exploring && explorer) {
+		const Explorer::Report& report = explorer->getReport();
+		ImGui::Separator();
+		ImGui::Text("%llu states, %llu frames in %.2fs", report.states, report.frames, report.seconds);
+		ImGui::Text("%d addresses run, %d frames deep%s", report.covered, report.depth, report.complete ? ", complete" : "");
+		std::vector<unsigned short> inputs;
+		char name[32];
+		int target = 0;
+		for (const ExplorerTarget& t : explored_targets) {
+			bool found = t.kind == ExplorerTarget::Kind::Pc
+				? explorer->getInputsTo(t.address, inputs)
+				: explorer->getTargetInputs(target++, inputs);
+			format_explorer_target(t, name, sizeof(name));
+			if (found) ImGui::Text("%s: found, %d frames of input", name, (int)inputs.size());
+			else ImGui::Text("%s: not found", name);
+		}
+		if (ImGui::Button("Save Report")) {
+			nfdchar_t* path = NULL;
+			if (NFD_SaveDialog("txt", NULL, &path) == NFD_OKAY) {
+				std::string text = explorer->format();
+				std::ofstream fs(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+				fs.write(text.data(), text.size());
+				free(path);
+			}
+		}
+	}
+
+	ImGui::End();
+}
+
+void draw_core_tests()
+{
+	if (!core_tests_open) return;
+
+	ImGui::SetNextWindowPos(ImVec2(535, 200), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Core Tests", &core_tests_open, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	static int count = 16;
+	static int frames = 200;
+	static std::string report;
+	ImGui::Text("Random ROMs, plus the loaded one, against the plain interpreter");
+	ImGui::SliderInt("ROMs", &count, 1, 100);
+	ImGui::SliderInt("Frames", &frames, 10, 1000);
+
+	std::vector<Chip8> machines;
+	if (ImGui::Button("Batch")) {
+		machines = makeTestMachines(count, 0x5eed);
+		if (rom_loaded) machines.push_back(fresh_machine());
+		runBatchTest(machines, frames, report);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Fusion")) {
+		machines = makeTestMachines(count, 0x5eed);
+		if (rom_loaded) machines.push_back(fresh_machine());
+		runFusionTest(machines, frames, report);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Compact")) {
+		machines = makeTestMachines(count, 0x5eed);
+		if (rom_loaded) machines.push_back(fresh_machine());
+		runCompactTest(machines, frames, report);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Explorer")) runExplorerTest(4, report);
+	ImGui::SameLine();
+	if (ImGui::Button("Shared Frames")) runSharedFrameTest(1000000, report);
+	if (!report.empty()) ImGui::TextUnformatted(report.c_str());
+
+	ImGui::End();
+}
+
 void cleanup()
 {
 	ImGui_ImplOpenGL3_Shutdown();
@@ -128,6 +995,11 @@ int main(int argc, char* args[])
 
 	init_imgui();
 
+	init_metrics();
+	Trace::nameThread("main");
+	//naming a region turns sharing on from the start, for recorders set up ahead of time
+	if (SDL_getenv("CHIP8_SHM_NAME")) share_frames = open_shared_frames();
+
 	SDL_Event e;
 
 	unsigned char screenBuf[64 * 32 * 3];
@@ -137,118 +1009,271 @@ int main(int argc, char* args[])
 
 	bool exit = false;
 
-	unsigned char keybuf[16] = { 0, 0, 0, 0,
-								 0, 0, 0, 0,
-								 0, 0, 0, 0,
-								 0, 0, 0, 0 };
-
-
 	GLuint chip_8_window;
 	glGenTextures(1, &chip_8_window);
 	glBindTexture(GL_TEXTURE_2D, chip_8_window);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 64, 32, 0, GL_RGB, GL_UNSIGNED_BYTE, screenBuf);
 
+	gridView.init();
+
+	double last_ms = host_ms();
+	double cycle_debt = 0;
+	bool screen_dirty = false;
+
+	int ui_frames = UI_SETTLE_FRAMES;
+	//emulated frames that drew since the last present. all but the last are never seen
+	int frames_drawn = 0;
+
 	while (!exit) {
-		glViewport(0, 0, ImGui::GetIO().DisplaySize.x, ImGui::GetIO().DisplaySize.y);
-		glClearColor(0, 0, 0, 0);
-		glClear(GL_COLOR_BUFFER_BIT);
+		TRACE_SCOPE("Frame");
+		double now_ms = host_ms();
+		//SDL stamps events with SDL_GetTicks, this moves them onto our clock
+		double ticks_to_host = now_ms - SDL_GetTicks();
 
-		if(rom_loaded)
-			core.doCycle();
-
-		while (SDL_PollEvent(&e) != 0) {
-			ImGui_ImplSDL2_ProcessEvent(&e);
-
-			if (e.type == SDL_QUIT) {
-				exit = true;
-			}
-			else if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
-				unsigned char input = 0;
-				if (e.type == SDL_KEYDOWN) input = 1;
-				switch (e.key.keysym.sym)
-				{
-				case SDLK_1:
-					keybuf[0x1] = input;
-					break;
-				case SDLK_2:
-					keybuf[0x2] = input;
-					break;
-				case SDLK_3:
-					keybuf[0x3] = input;
-					break;
-				case SDLK_4:
-					keybuf[0xc] = input;
-					break;
-				case SDLK_q:
-					keybuf[0x4] = input;
-					break;
-				case SDLK_w:
-					keybuf[0x5] = input;
-					break;
-				case SDLK_e:
-					keybuf[0x6] = input;
-					break;
-				case SDLK_r:
-					keybuf[0xd] = input;
-					break;
-				case SDLK_a:
-					keybuf[0x7] = input;
-					break;
-				case SDLK_s:
-					keybuf[0x8] = input;
-					break;
-				case SDLK_d:
-					keybuf[0x9] = input;
-					break;
-				case SDLK_f:
-					keybuf[0xe] = input;
-					break;
-				case SDLK_z:
-					keybuf[0xa] = input;
-					break;
-				case SDLK_x:
-					keybuf[0x0] = input;
-					break;
-				case SDLK_c:
-					keybuf[0xb] = input;
-					break;
-				case SDLK_v:
-					keybuf[0xf] = input;
-					break;
+		{
+			TRACE_SCOPE("Poll events");
+			while (SDL_PollEvent(&e) != 0) {
+				ImGui_ImplSDL2_ProcessEvent(&e);
+				ui_frames = UI_SETTLE_FRAMES;
+
+				if (e.type == SDL_QUIT) {
+					exit = true;
+				}
+				else if ((e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) && !e.key.repeat) {
+					int index = map_key(e.key.keysym.sym);
+					if (index < 0) continue;
+
+					if (e.type == SDL_KEYDOWN) local_keys |= 1 << index;
+					else local_keys &= ~(1 << index);
+
+					InputQueue::Event input;
+					input.hostTime = e.key.timestamp + ticks_to_host;
+					input.key = (unsigned char)index;
+					input.pressed = e.type == SDL_KEYDOWN;
+
+					//line the event up with the emulated time we are going to reach at its host time.
+					//anything older than the last batch goes in at the next instruction
+					double ahead = (input.hostTime - last_ms) * time_per_second() / 1000.0;
+					input.cycle = core.getTime() + (ahead > 0 ? (unsigned long long)ahead : 0);
+
+					if (!inputQueue.push(input)) {
+						core.setKey(input.key, input.pressed);
+					}
 				}
 			}
-			core.loadKey(keybuf);
 		}
 
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplSDL2_NewFrame(window);
-		ImGui::NewFrame();
-		draw_imgui();
+		if (netSession.isRunning()) {
+			netplay_debt += (now_ms - last_ms) * 60 / 1000.0;
+			if (netplay_debt > 60 * MAX_CATCH_UP_MS / 1000.0)
+				netplay_debt = 60 * MAX_CATCH_UP_MS / 1000.0;
+
+			TRACE_SCOPE("Netplay frames");
+			while (netplay_debt >= 1) {
+				unsigned long long startCycles = netSession.getCore().getCycles();
+				//a stall means the peer is behind, try again next loop
+				if (!netSession.advanceFrame(local_keys)) break;
+				netplay_debt -= 1;
+				//the session's machine is the one on screen
+				stateView.publish(netSession.getCore());
+				share_frame(netSession.getCore());
+				screen_dirty = true;
+				frames_drawn++;
+				metrics.add(metric.emulatedFrames);
+				metrics.add(metric.instructions, netSession.getCore().getCycles() - startCycles);
+				if (netplay_open) ui_frames = 1;
+			}
+			inputQueue.clear();
+		}
+		else if (rom_loaded && !(debugger_open && debugger.isPaused())) {
+			//a budget of emulated time, spent by however long each instruction takes
+			cycle_debt += (now_ms - last_ms) * time_per_second() / 1000.0;
+			//don't try to catch up after a long stall (window drag, breakpoint...)
+			if (cycle_debt > time_per_second() * MAX_CATCH_UP_MS / 1000.0)
+				cycle_debt = time_per_second() * MAX_CATCH_UP_MS / 1000.0;
+
+			unsigned long long frame = core.getFrame();
+			unsigned long long startFrame = frame;
+			unsigned long long startCycles = core.getCycles();
+			unsigned long long keyWait = 0;
+			bool frameDrew = false;
+			bool stopped = false;
+
+			{
+				TRACE_SCOPE("Run cycles");
+				while (cycle_debt >= 1 && !stopped) {
+					double keyTime = inputQueue.applyDue(core);
+					if (keyTime >= 0) latencyStats.keyApplied(keyTime);
+
+					//only pay for the debug checks while the debugger is attached
+					unsigned long long time = core.getTime();
+					if (debugger_open)
+						stopped = !core.doCycle(debugger);
+					else
+						core.doCycle();
+					cycle_debt -= core.getTime() - time;
+					if (core.isWaitingForKey()) keyWait++;
 
-		if (core.drawFlag) {
-			core.loadScreen(screenBuf);
+					if (core.drawFlag) {
+						screen_dirty = true;
+						frameDrew = true;
+						latencyStats.screenChanged();
+					}
+					if (stopped || core.getFrame() != frame) {
+						stateView.publish(core);
+						share_frame(core);
+						frame = core.getFrame();
+						if (frameDrew) frames_drawn++;
+						frameDrew = false;
+					}
+				}
+			}
+
+			//counted once per batch, the loop above stays free of them
+			metrics.add(metric.instructions, core.getCycles() - startCycles);
+			metrics.add(metric.keyWaitCycles, keyWait);
+			metrics.add(metric.emulatedFrames, frame - startFrame);
+
+			if (stopped) {
+				cycle_debt = 0;
+				//show where the real machine stopped, not the speculated one
+				screen_dirty = true;
+			}
+			else if (runAhead.isEnabled() && frame != startFrame) {
+				TRACE_SCOPE("Run ahead");
+				if (runAhead.run(core, local_keys)) latencyStats.screenChanged();
+				screen_dirty = true;
+			}
+
+			if (core.isSoundOn() != beeping) {
+				beeping = core.isSoundOn();
+				if (beeping) {
+					std::cout << "BEEP" << std::endl;
+					metrics.add(metric.beeps);
+				}
+			}
+
+			//tool windows show live state, keep them current
+			if ((debugger_open || latency_open) && (stopped || frame != startFrame))
+				ui_frames = 1;
+		}
+		else {
+			cycle_debt = 0;
+			if (!rom_loaded) inputQueue.flush(core);
+		}
+
+		if (gridView.isRunning()) {
+			grid_debt += (now_ms - last_ms) * 60 * speed / 1000.0;
+			if (grid_debt > 60 * MAX_CATCH_UP_MS / 1000.0)
+				grid_debt = 60 * MAX_CATCH_UP_MS / 1000.0;
+
+			while (grid_debt >= 1) {
+				gridView.runFrame();
+				grid_debt -= 1;
+				if (grid_open) ui_frames = 1;
+			}
+		}
+		//progress counters
+		if (explorer_open && exploring) ui_frames = 1;
+		last_ms = now_ms;
+		update_metrics(now_ms);
+
+		if (power_saving && !screen_dirty && ui_frames == 0) {
+			wait_for_next_event(now_ms, cycle_debt);
+			continue;
+		}
+		if (ui_frames > 0) ui_frames--;
+
+		glViewport(0, 0, ImGui::GetIO().DisplaySize.x, ImGui::GetIO().DisplaySize.y);
+		glClearColor(0, 0, 0, 0);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		if (screen_dirty) {
+			{
+				TRACE_SCOPE("loadScreen");
+				bool speculate = runAhead.isEnabled() && !(debugger_open && debugger.isPaused());
+				if (netSession.isRunning())
+					netSession.getCore().loadScreen(screenBuf);
+				else if (speculate)
+					runAhead.getFuture().loadScreen(screenBuf);
+				else
+					core.loadScreen(screenBuf);
+			}
 
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-			glBindTexture(GL_TEXTURE_2D, chip_8_window);
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 32, GL_RGB, GL_UNSIGNED_BYTE, screenBuf);
+			{
+				TRACE_SCOPE("glTexSubImage2D");
+				glBindTexture(GL_TEXTURE_2D, chip_8_window);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 32, GL_RGB, GL_UNSIGNED_BYTE, screenBuf);
+			}
+			screen_dirty = false;
+			metrics.add(metric.textureUploadBytes, sizeof(screenBuf));
+
+			if (frames_drawn > 1) metrics.add(metric.framesDropped, frames_drawn - 1);
+			frames_drawn = 0;
 		}
-		
-		ImGui::SetNextWindowSize(ImVec2(530, 300));
-		ImGui::SetNextWindowPos(ImVec2(0, 25));
-		ImGui::Begin("Chip-8", 0, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse);
-		ImGui::Image((void*)chip_8_window, ImVec2(512, 256));
-		ImGui::End();
+		if (grid_open) metrics.add(metric.textureUploadBytes, gridView.upload());
+
+		{
+			TRACE_SCOPE("Build UI");
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplSDL2_NewFrame(window);
+			ImGui::NewFrame();
+			draw_imgui();
+			draw_debugger();
+			draw_latency();
+			draw_netplay();
+			draw_metrics();
+			draw_grid();
+			draw_explorer();
+			draw_core_tests();
 
-		ImGui::Render();
+			ImGui::SetNextWindowSize(ImVec2(530, 300));
+			ImGui::SetNextWindowPos(ImVec2(0, 25));
+			ImGui::Begin("Chip-8", 0, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse);
+			ImGui::Image((void*)chip_8_window, ImVec2(512, 256));
+			ImGui::End();
+		}
+
+		ImDrawData* draw_data;
+		{
+			TRACE_SCOPE("ImGui::Render");
+			ImGui::Render();
+			draw_data = ImGui::GetDrawData();
+			ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+		}
+		{
+			TRACE_SCOPE("SDL_GL_SwapWindow");
+			SDL_GL_SwapWindow(window);
+		}
+		double presented_ms = host_ms();
+		latencyStats.framePresented(presented_ms);
 
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-		SDL_GL_SwapWindow(window);
+		//the ImGui backend issues one draw call per command
+		int draw_calls = 0;
+		for (int i = 0; i < draw_data->CmdListsCount; i++) {
+			draw_calls += draw_data->CmdLists[i]->CmdBuffer.Size;
+		}
+		metrics.add(metric.drawCalls, draw_calls);
+		metrics.add(metric.framesPresented);
+		metrics.observe(metric.hostFrameMs, (float)(presented_ms - now_ms));
 
-		std::this_thread::sleep_for(std::chrono::nanoseconds(2500));
+		if (power_saving) {
+			if (ui_frames == 0) wait_for_next_event(now_ms, cycle_debt);
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(2500));
+		}
 	}
 
+	if (explore_thread.joinable()) {
+		explorer->stop();
+		explore_thread.join();
+	}
+	sharedFrames.close();
+	gridView.cleanup();
 	SDL_DestroyWindow(window);
 
 	return 0;